@@ -0,0 +1,425 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "timer.h"
+
+// 内存局部性 (续): allocation.h 只测了 push_back，真正的差别在之后的遍历。
+// Four costs per container, at sizes from L1-resident to DRAM-resident:
+//   build     push_back n elements (allocation + growth copies)
+//   traverse  sum all elements (sequential streaming vs pointer chasing)
+//   random    read element i for random i (lists: walk from the front)
+//   erase     erase elements in the middle (memmove of half vs relinking)
+
+// Vector of trivially copyable T that grows by `growth_factor` (std::vector in
+// libstdc++ uses 2). Smaller factors waste less memory but copy more often.
+template <typename T>
+class GrowthVector {
+    static_assert(std::is_trivially_copyable<T>::value, "GrowthVector moves elements with memcpy");
+
+public:
+    explicit GrowthVector(double growth_factor = 2.0) : growth_factor_(growth_factor) {}
+    ~GrowthVector() { std::free(data_); }
+    GrowthVector(const GrowthVector&) = delete;
+    GrowthVector& operator=(const GrowthVector&) = delete;
+    GrowthVector(GrowthVector&& other) noexcept { swap(other); }
+
+    void push_back(const T& value) {
+        if (size_ == capacity_) {
+            grow(std::max(capacity_ + 1, static_cast<size_t>(capacity_ * growth_factor_)));
+        }
+        data_[size_++] = value;
+    }
+
+    void erase(size_t index) {
+        std::memmove(data_ + index, data_ + index + 1, (size_ - index - 1) * sizeof(T));
+        --size_;
+    }
+
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    size_t reallocations() const { return reallocations_; }
+
+private:
+    void grow(size_t capacity) {
+        T* data = static_cast<T*>(std::realloc(data_, capacity * sizeof(T)));
+        if (data == nullptr) throw std::bad_alloc();
+        data_ = data;
+        capacity_ = capacity;
+        ++reallocations_;
+    }
+
+    void swap(GrowthVector& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(growth_factor_, other.growth_factor_);
+        std::swap(reallocations_, other.reallocations_);
+    }
+
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    double growth_factor_ = 2.0;
+    size_t reallocations_ = 0;
+};
+
+// Vector with the first N elements stored inline: no heap allocation and no
+// extra pointer hop while it stays small. Trivially copyable T only.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector moves elements with memcpy");
+
+public:
+    SmallVector() = default;
+    ~SmallVector() {
+        if (data_ != inline_) std::free(data_);
+    }
+    SmallVector(const SmallVector&) = delete;
+    SmallVector& operator=(const SmallVector&) = delete;
+    SmallVector(SmallVector&& other) noexcept {
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        if (other.data_ == other.inline_) {
+            std::memcpy(inline_, other.inline_, size_ * sizeof(T));
+        } else {
+            data_ = other.data_;
+        }
+        other.data_ = other.inline_;
+        other.size_ = 0;
+        other.capacity_ = N;
+    }
+
+    void push_back(const T& value) {
+        if (size_ == capacity_) {
+            size_t capacity = capacity_ * 2;
+            T* data = static_cast<T*>(std::malloc(capacity * sizeof(T)));
+            if (data == nullptr) throw std::bad_alloc();
+            std::memcpy(data, data_, size_ * sizeof(T));
+            if (data_ != inline_) std::free(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+        data_[size_++] = value;
+    }
+
+    void erase(size_t index) {
+        std::memmove(data_ + index, data_ + index + 1, (size_ - index - 1) * sizeof(T));
+        --size_;
+    }
+
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool is_inline() const { return data_ == inline_; }
+
+private:
+    T inline_[N];
+    T* data_ = inline_;
+    size_t size_ = 0;
+    size_t capacity_ = N;
+};
+
+// Intrusive doubly linked list: the links live in the element, so there is no
+// separate node allocation.
+struct ListHook {
+    ListHook* prev = nullptr;
+    ListHook* next = nullptr;
+};
+
+struct PooledInt {
+    ListHook hook;  // first member: a hook pointer is the element pointer
+    int value;
+};
+
+// Bump allocator over fixed-size slabs with a free list, so nodes built in order
+// sit next to each other in memory.
+template <typename T>
+class NodePool {
+public:
+    static constexpr size_t kSlabNodes = 4096;
+
+    ~NodePool() {
+        for (T* slab : slabs_) std::free(slab);
+    }
+
+    T* allocate() {
+        if (free_ != nullptr) {
+            T* node = free_;
+            free_ = *reinterpret_cast<T**>(node);
+            return node;
+        }
+        if (slabs_.empty() || used_ == kSlabNodes) {
+            T* slab = static_cast<T*>(std::malloc(kSlabNodes * sizeof(T)));
+            if (slab == nullptr) throw std::bad_alloc();
+            slabs_.push_back(slab);
+            used_ = 0;
+        }
+        return slabs_.back() + used_++;
+    }
+
+    void deallocate(T* node) {
+        *reinterpret_cast<T**>(node) = free_;
+        free_ = node;
+    }
+
+private:
+    std::vector<T*> slabs_;
+    size_t used_ = 0;
+    T* free_ = nullptr;
+};
+
+class PooledIntList {
+public:
+    PooledIntList() { head_.prev = head_.next = &head_; }
+    PooledIntList(const PooledIntList&) = delete;
+    PooledIntList& operator=(const PooledIntList&) = delete;
+
+    void push_back(int value) {
+        PooledInt* node = pool_.allocate();
+        node->value = value;
+        ListHook* hook = &node->hook;
+        hook->prev = head_.prev;
+        hook->next = &head_;
+        head_.prev->next = hook;
+        head_.prev = hook;
+        ++size_;
+    }
+
+    // Unlinks `hook` and returns the next one.
+    ListHook* erase(ListHook* hook) {
+        ListHook* next = hook->next;
+        hook->prev->next = next;
+        next->prev = hook->prev;
+        pool_.deallocate(reinterpret_cast<PooledInt*>(hook));
+        --size_;
+        return next;
+    }
+
+    ListHook* first() { return head_.next; }
+    const ListHook* first() const { return head_.next; }
+    const ListHook* sentinel() const { return &head_; }
+    static int value(const ListHook* hook) { return reinterpret_cast<const PooledInt*>(hook)->value; }
+    size_t size() const { return size_; }
+
+private:
+    ListHook head_;
+    NodePool<PooledInt> pool_;
+    size_t size_ = 0;
+};
+
+// Elements per row in the SmallVector comparison (fits the 8 inline slots).
+constexpr size_t kSmallRow = 6;
+
+struct ContainerCosts {
+    double build_ns = 0;     // per element
+    double traverse_ns = 0;  // per element
+    double random_ns = 0;    // per access
+    double erase_ns = 0;     // per erased element
+};
+
+template <typename F>
+double elapsed_ns(F&& f) {
+    Stopwatch sw;
+    sw.start();
+    f();
+    return sw.stop().ns;
+}
+
+// Drives one container through the four phases. `build(n)` returns the filled
+// container as a std::unique_ptr; `access(c, i)` returns element i;
+// `erase_middle(c, k)` finds the middle and returns the timed step that erases
+// k elements there.
+template <typename Container, typename Build, typename Traverse, typename Access, typename EraseMiddle>
+ContainerCosts measure_container(size_t n, size_t access_ops, Build&& build, Traverse&& traverse, Access&& access,
+                                 EraseMiddle&& erase_middle) {
+    ContainerCosts costs;
+    volatile long checksum = 0;
+    std::unique_ptr<Container> container;
+    costs.build_ns = elapsed_ns([&] { container = build(n); }) / n;
+    traverse(*container);  // first pass may still fault pages in
+    long sum = 0;
+    costs.traverse_ns = elapsed_ns([&] { sum += traverse(*container); }) / n;
+
+    std::mt19937_64 rng(91);
+    std::vector<size_t> indices(access_ops);
+    for (auto& i : indices) i = rng() % n;
+    costs.random_ns = elapsed_ns([&] {
+        for (size_t i : indices) sum += access(*container, i);
+    }) / access_ops;
+
+    size_t erases = std::min<size_t>(1000, n / 2);
+    auto erase = erase_middle(*container, erases);
+    costs.erase_ns = elapsed_ns(erase) / erases;
+    checksum += sum;
+    return costs;
+}
+
+inline void print_container_costs(const std::string& label, const ContainerCosts& costs) {
+    std::cout << "    " << label << ": build " << costs.build_ns << ", traverse " << costs.traverse_ns
+              << ", random " << costs.random_ns << ", erase-middle " << costs.erase_ns << "\n";
+}
+
+template <typename Vector>
+void measure_vector_like(const std::string& label, size_t n, size_t access_ops, std::function<std::unique_ptr<Vector>()> make) {
+    auto costs = measure_container<Vector>(
+        n, access_ops,
+        [&make](size_t count) {
+            std::unique_ptr<Vector> v = make();
+            for (size_t i = 0; i < count; ++i) v->push_back(static_cast<int>(i));
+            return v;
+        },
+        [](const Vector& v) {
+            long sum = 0;
+            for (int x : v) sum += x;
+            return sum;
+        },
+        [](const Vector& v, size_t i) { return static_cast<long>(v[i]); },
+        [](Vector& v, size_t k) {
+            return [&v, k] {
+                for (size_t j = 0; j < k; ++j) {
+                    if constexpr (std::is_same<Vector, std::vector<int>>::value || std::is_same<Vector, std::deque<int>>::value) {
+                        v.erase(v.begin() + v.size() / 2);
+                    } else {
+                        v.erase(v.size() / 2);
+                    }
+                }
+            };
+        });
+    print_container_costs(label, costs);
+}
+
+// ns per element (build, traverse), per access (random) and per erased element
+// (erase-middle). Lists get fewer random accesses: each one walks ~n/2 nodes.
+// The nested rows compare n/6 rows of 6 ints held in std::vector vs
+// SmallVector<int, 8> (inline, no per-row allocation).
+void benchmark_containers(size_t max_elements = size_t(1) << 24) {
+    std::cout << "Container locality (ns; int elements):\n";
+    // L1, L2 and LLC-sized steps, then max_elements itself (the DRAM point).
+    std::vector<size_t> sizes;
+    for (size_t n = size_t(1) << 10; n < max_elements; n <<= 4) sizes.push_back(n);
+    sizes.push_back(max_elements);
+    for (size_t n : sizes) {
+        std::cout << "  n = " << n << " (" << n * sizeof(int) / 1024 << " KiB of ints)\n";
+        const size_t access_ops = 100000;
+        const size_t list_access_ops = std::max<size_t>(4, std::min<size_t>(access_ops, (size_t(1) << 26) / n));
+
+        measure_vector_like<std::vector<int>>("std::vector", n, access_ops, [] { return std::make_unique<std::vector<int>>(); });
+        for (const char* factor : {"1.5", "4.0"}) {
+            measure_vector_like<GrowthVector<int>>(std::string("GrowthVector x") + factor, n, access_ops,
+                                                   [factor] { return std::make_unique<GrowthVector<int>>(std::atof(factor)); });
+        }
+        measure_vector_like<std::deque<int>>("std::deque", n, access_ops, [] { return std::make_unique<std::deque<int>>(); });
+
+        auto list_costs = measure_container<std::list<int>>(
+            n, list_access_ops,
+            [](size_t count) {
+                auto l = std::make_unique<std::list<int>>();
+                for (size_t i = 0; i < count; ++i) l->push_back(static_cast<int>(i));
+                return l;
+            },
+            [](const std::list<int>& l) {
+                long sum = 0;
+                for (int x : l) sum += x;
+                return sum;
+            },
+            [](const std::list<int>& l, size_t i) { return static_cast<long>(*std::next(l.begin(), i)); },
+            [](std::list<int>& l, size_t k) {
+                auto it = std::next(l.begin(), l.size() / 2);
+                return [&l, it, k]() mutable {
+                    for (size_t j = 0; j < k; ++j) it = l.erase(it);
+                };
+            });
+        print_container_costs("std::list", list_costs);
+
+        auto pooled_costs = measure_container<PooledIntList>(
+            n, list_access_ops,
+            [](size_t count) {
+                auto l = std::make_unique<PooledIntList>();
+                for (size_t i = 0; i < count; ++i) l->push_back(static_cast<int>(i));
+                return l;
+            },
+            [](const PooledIntList& l) {
+                long sum = 0;
+                for (const ListHook* h = l.first(); h != l.sentinel(); h = h->next) sum += PooledIntList::value(h);
+                return sum;
+            },
+            [](const PooledIntList& l, size_t i) {
+                const ListHook* h = l.first();
+                while (i-- > 0) h = h->next;
+                return static_cast<long>(PooledIntList::value(h));
+            },
+            [](PooledIntList& l, size_t k) {
+                ListHook* h = l.first();
+                for (size_t steps = l.size() / 2; steps > 0; --steps) h = h->next;
+                return [&l, h, k]() mutable {
+                    for (size_t j = 0; j < k; ++j) h = l.erase(h);
+                };
+            });
+        print_container_costs("pooled intrusive list", pooled_costs);
+
+        size_t rows = std::max<size_t>(1, n / kSmallRow);
+        auto nested = [&](const std::string& label, auto* tag) {
+            using Row = std::remove_pointer_t<decltype(tag)>;
+            using Rows = std::vector<Row>;
+            auto costs = measure_container<Rows>(
+                rows * kSmallRow, access_ops,
+                [rows](size_t) {
+                    auto r = std::make_unique<Rows>();
+                    r->reserve(rows);
+                    for (size_t i = 0; i < rows; ++i) {
+                        r->emplace_back();
+                        for (size_t j = 0; j < kSmallRow; ++j) r->back().push_back(static_cast<int>(i * kSmallRow + j));
+                    }
+                    return r;
+                },
+                [](const Rows& r) {
+                    long sum = 0;
+                    for (const auto& row : r) {
+                        for (int x : row) sum += x;
+                    }
+                    return sum;
+                },
+                [](const Rows& r, size_t i) { return static_cast<long>(r[(i / kSmallRow) % r.size()][i % kSmallRow]); },
+                [](Rows& r, size_t k) {
+                    // erase the middle element of the rows around the middle, wrapping
+                    // around when there are fewer than k rows
+                    size_t first = r.size() / 2 - std::min(r.size(), k) / 2;
+                    return [&r, first, k] {
+                        for (size_t j = 0; j < k; ++j) {
+                            Row& row = r[(first + j) % r.size()];
+                            if constexpr (std::is_same<Row, std::vector<int>>::value) {
+                                row.erase(row.begin() + row.size() / 2);
+                            } else {
+                                row.erase(row.size() / 2);
+                            }
+                        }
+                    };
+                });
+            print_container_costs(label, costs);
+        };
+        nested("rows of std::vector<int>", static_cast<std::vector<int>*>(nullptr));
+        nested("rows of SmallVector<int, 8>", static_cast<SmallVector<int, 8>*>(nullptr));
+    }
+}
+
+#endif //CONTAINER_H
@@ -0,0 +1,310 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "timer.h"
+
+// 值语义的代价: 拷贝 vs 移动 vs 原地构造 vs RVO/NRVO。
+// Every row reports ns/op next to heap allocations/op and, for the Tracked
+// type, copy and move constructor calls/op. The allocation column is the one to
+// cite in review: a "cheap" copy of a std::string or std::vector is one
+// malloc + memcpy + free.
+//
+// Allocations are counted by CountingAllocator, which the strings and vectors
+// in these rows use instead of std::allocator. The global operator new is left
+// alone, so no other benchmark pays for the counting. CountingAllocator is
+// stateless: containers copy, move and swap exactly as with std::allocator.
+
+struct AllocationCounters {
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t copies = 0;  // Tracked copy constructions / assignments
+    size_t moves = 0;   // Tracked move constructions / assignments
+};
+
+inline thread_local AllocationCounters allocation_counters;
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        ++allocation_counters.allocations;
+        allocation_counters.bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+// Same SSO buffer (15 chars in libstdc++) as std::string.
+using CountedString = std::basic_string<char, std::char_traits<char>, CountingAllocator<char>>;
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
+
+// Payload that counts how it is copied and moved. The vector member makes a
+// copy allocate, like the strings and vectors passed around in services.
+struct Tracked {
+    CountedVector<int> data;
+
+    explicit Tracked(size_t n = 0) : data(n, 1) {}
+    Tracked(const Tracked& other) : data(other.data) { ++allocation_counters.copies; }
+    Tracked(Tracked&& other) noexcept : data(std::move(other.data)) { ++allocation_counters.moves; }
+    Tracked& operator=(const Tracked& other) {
+        data = other.data;
+        ++allocation_counters.copies;
+        return *this;
+    }
+    Tracked& operator=(Tracked&& other) noexcept {
+        data = std::move(other.data);
+        ++allocation_counters.moves;
+        return *this;
+    }
+};
+
+// Trivially copyable struct: copying it is a memcpy, moving it is the same memcpy.
+struct LargeStruct {
+    long fields[32];  // 256 bytes
+};
+
+// Makes the compiler assume `p` is read and written, so the work that produced
+// it cannot be dropped.
+inline void escape(const void* p) {
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+struct CopyCost {
+    double ns = 0;
+    double allocations = 0;
+    double copies = 0;
+    double moves = 0;
+};
+
+template <typename F>
+CopyCost measure_copy_cost(size_t iterations, F&& f) {
+    f();  // warm up the allocator's free lists
+    AllocationCounters before = allocation_counters;
+    Stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < iterations; ++i) f();
+    Timing t = sw.stop();
+    const AllocationCounters& after = allocation_counters;
+    CopyCost cost;
+    cost.ns = t.ns / iterations;
+    cost.allocations = static_cast<double>(after.allocations - before.allocations) / iterations;
+    cost.copies = static_cast<double>(after.copies - before.copies) / iterations;
+    cost.moves = static_cast<double>(after.moves - before.moves) / iterations;
+    return cost;
+}
+
+inline void print_copy_cost(const std::string& label, const CopyCost& cost) {
+    std::streamsize precision = std::cout.precision();
+    std::cout << "  " << std::left << std::setw(52) << label << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << cost.ns << std::setw(9) << cost.allocations << std::setw(8) << cost.copies
+              << std::setw(8) << cost.moves << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout.precision(precision);
+}
+
+// Return paths. noinline keeps each one a real call, as across layers.
+__attribute__((noinline)) Tracked return_prvalue(size_t n) {
+    return Tracked(n);  // guaranteed elision (C++17)
+}
+
+__attribute__((noinline)) Tracked return_named(size_t n) {
+    Tracked t(n);
+    return t;  // NRVO
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpessimizing-move"
+__attribute__((noinline)) Tracked return_std_move(size_t n) {
+    Tracked t(n);
+    return std::move(t);  // blocks NRVO: one extra move
+}
+#pragma GCC diagnostic pop
+
+__attribute__((noinline)) Tracked return_one_of_two(size_t n, bool first) {
+    Tracked a(n);
+    Tracked b(n);
+    if (first) return a;  // NRVO impossible: implicit move
+    return b;
+}
+
+__attribute__((noinline)) Tracked return_conditional(size_t n, bool first) {
+    Tracked a(n);
+    Tracked b(n);
+    return first ? a : b;  // not a plain name: copy
+}
+
+__attribute__((noinline)) void fill_out_param(size_t n, Tracked& out) {
+    out.data.assign(n, 1);  // reuses out's capacity
+}
+
+__attribute__((noinline)) long by_value(LargeStruct s) { return s.fields[0] + s.fields[31]; }
+__attribute__((noinline)) long by_reference(const LargeStruct& s) { return s.fields[0] + s.fields[31]; }
+__attribute__((noinline)) long shared_by_value(std::shared_ptr<int> p) { return *p; }
+__attribute__((noinline)) long shared_by_reference(const std::shared_ptr<int>& p) { return *p; }
+
+// Cost table: ns/op, heap allocations/op, Tracked copies/op, Tracked moves/op.
+void benchmark_copy_move(size_t iterations = 1000000) {
+    std::cout << "Copy / move / elision costs (" << iterations << " iterations):\n";
+    std::cout << "  " << std::left << std::setw(52) << "case" << std::right << std::setw(10) << "ns/op"
+              << std::setw(9) << "allocs" << std::setw(8) << "copies" << std::setw(8) << "moves" << "\n";
+
+    // Strings: libstdc++ keeps up to 15 chars inline (SSO), so a copy of 15
+    // chars is a memcpy and a copy of 16 chars is a malloc. Moving an SSO
+    // string still copies its bytes; moving a heap string steals the pointer.
+    for (size_t length : {size_t(15), size_t(16), size_t(64), size_t(1024)}) {
+        CountedString source(length, 'x');
+        std::string label = "string(" + std::to_string(length) + ") ";
+        print_copy_cost(label + "copy", measure_copy_cost(iterations, [&] {
+            CountedString copy(source);
+            escape(&copy);
+        }));
+        print_copy_cost(label + "move (and move back)", measure_copy_cost(iterations, [&] {
+            CountedString moved(std::move(source));
+            escape(&moved);
+            source = std::move(moved);
+        }));
+    }
+
+    // The bulk_insert pattern: a gathered temporary replaces a member vector.
+    {
+        CountedVector<int> member(100000, 1);
+        CountedVector<int> temporary(100000, 2);
+        print_copy_cost("vector<int>(100k) copy-assign", measure_copy_cost(iterations / 100, [&] {
+            CountedVector<int> scratch(temporary);
+            member = scratch;
+            escape(member.data());
+        }));
+        print_copy_cost("vector<int>(100k) move-assign", measure_copy_cost(iterations / 100, [&] {
+            CountedVector<int> scratch(temporary);
+            member = std::move(scratch);
+            escape(member.data());
+        }));
+        print_copy_cost("vector<int>(100k) swap (bulk_insert)", measure_copy_cost(iterations / 100, [&] {
+            CountedVector<int> scratch(temporary);
+            member.swap(scratch);
+            escape(member.data());
+        }));
+    }
+
+    // Large trivially copyable struct across a call.
+    {
+        LargeStruct s{};
+        long sum = 0;
+        print_copy_cost("LargeStruct(256B) by value", measure_copy_cost(iterations, [&] { sum += by_value(s); }));
+        print_copy_cost("LargeStruct(256B) by const&", measure_copy_cost(iterations, [&] { sum += by_reference(s); }));
+        escape(&sum);
+    }
+
+    // Return paths for a 64-int Tracked (one allocation per construction). The
+    // size is opaque so that no case gets a constant-folded fill loop.
+    size_t tracked_size = 64;
+    bool flag = true;
+    escape(&tracked_size);
+    escape(&flag);
+    print_copy_cost("return prvalue (RVO)", measure_copy_cost(iterations, [&] {
+        Tracked t = return_prvalue(tracked_size);
+        escape(&t);
+    }));
+    print_copy_cost("return named local (NRVO)", measure_copy_cost(iterations, [&] {
+        Tracked t = return_named(tracked_size);
+        escape(&t);
+    }));
+    print_copy_cost("return std::move(local)", measure_copy_cost(iterations, [&] {
+        Tracked t = return_std_move(tracked_size);
+        escape(&t);
+    }));
+    print_copy_cost("return one of two locals (implicit move)", measure_copy_cost(iterations, [&] {
+        Tracked t = return_one_of_two(tracked_size, flag);
+        escape(&t);
+    }));
+    print_copy_cost("return cond ? a : b (copy)", measure_copy_cost(iterations, [&] {
+        Tracked t = return_conditional(tracked_size, flag);
+        escape(&t);
+    }));
+    {
+        Tracked out;
+        print_copy_cost("out-parameter (reused capacity)", measure_copy_cost(iterations, [&] {
+            fill_out_param(tracked_size, out);
+            escape(&out);
+        }));
+    }
+
+    // push_back vs emplace_back into a reserved vector, cleared every 1000
+    // elements so that the vector itself never reallocates.
+    {
+        constexpr size_t kBatch = 1000;
+        CountedVector<Tracked> tracked;
+        tracked.reserve(kBatch);
+        Tracked lvalue(tracked_size);
+        auto batch = [&](auto&& add) {
+            return measure_copy_cost(iterations / kBatch, [&] {
+                tracked.clear();
+                for (size_t i = 0; i < kBatch; ++i) add();
+                escape(tracked.data());
+            });
+        };
+        auto per_element = [](CopyCost cost) {
+            cost.ns /= kBatch;
+            cost.allocations /= kBatch;
+            cost.copies /= kBatch;
+            cost.moves /= kBatch;
+            return cost;
+        };
+        print_copy_cost("push_back(lvalue)", per_element(batch([&] { tracked.push_back(lvalue); })));
+        print_copy_cost("push_back(Tracked(n))", per_element(batch([&] { tracked.push_back(Tracked(tracked_size)); })));
+        print_copy_cost("emplace_back(n)", per_element(batch([&] { tracked.emplace_back(tracked_size); })));
+
+        CountedVector<CountedString> strings;
+        strings.reserve(kBatch);
+        const char* text = "a key longer than fifteen chars";
+        auto string_batch = [&](auto&& add) {
+            return per_element(measure_copy_cost(iterations / kBatch, [&] {
+                strings.clear();
+                for (size_t i = 0; i < kBatch; ++i) add();
+                escape(strings.data());
+            }));
+        };
+        print_copy_cost("vector<string>::push_back(const char*)",
+                        string_batch([&] { strings.push_back(text); }));
+        print_copy_cost("vector<string>::emplace_back(const char*)",
+                        string_batch([&] { strings.emplace_back(text); }));
+    }
+
+    // shared_ptr: a copy is an atomic increment plus an atomic decrement.
+    {
+        auto shared = std::make_shared<int>(1);
+        long sum = 0;
+        print_copy_cost("shared_ptr by value (copy)", measure_copy_cost(iterations, [&] {
+            sum += shared_by_value(shared);
+        }));
+        print_copy_cost("shared_ptr move (and move back)", measure_copy_cost(iterations, [&] {
+            std::shared_ptr<int> moved(std::move(shared));
+            escape(&moved);
+            shared = std::move(moved);
+        }));
+        print_copy_cost("shared_ptr by const&", measure_copy_cost(iterations, [&] {
+            sum += shared_by_reference(shared);
+        }));
+        escape(&sum);
+    }
+}
+
+#endif //COPY_H
@@ -0,0 +1,259 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#include "instruction.h"
+
+// Environment hardening: `taskset -c N` from the README, done by the binary
+// when --cpu=N is given, plus the checks that tell whether a number is worth
+// keeping. Without --cpu nothing is pinned, so the thread pools, TBB and the
+// KV server keep every core; the checks then use the machine-wide counters.
+// 1. 绑核：sched_setaffinity, 避免迁移带来的冷缓存。
+// 2. 频率：governor 不是 performance / turbo 打开 --> 频率随负载和温度变化。
+// 3. 噪音邻居：同一物理核的 SMT sibling 在跑别的任务, 或者 VM 的 steal time。
+// Before and after each benchmark the core frequency is estimated from the
+// 1-cycle add chain; a drift between the two means the clock moved under us.
+
+struct EnvironmentOptions {
+  bool enabled = false;
+  int cpu = -1;                    // -1: do not pin
+  bool raise_priority = false;     // nice -20, needs CAP_SYS_NICE
+  int warmup_ms = 200;
+  double max_freq_drift = 0.05;    // relative change allowed before/after
+  double max_sibling_busy = 0.10;  // fraction of the run the SMT sibling may be busy
+  double max_involuntary_per_sec = 10;  // preemptions per second of run time
+};
+
+// Per-CPU counters from /proc/stat, in USER_HZ ticks.
+struct CpuTimes {
+  uint64_t busy = 0, total = 0, steal = 0;
+};
+
+inline std::string read_sysfs(const std::string& path) {
+  std::ifstream in(path);
+  std::string value;
+  if (!(in >> value)) {
+    return "";
+  }
+  return value;
+}
+
+// cpu -1: the machine-wide "cpu" line.
+inline CpuTimes read_cpu_times(int cpu) {
+  std::ifstream in("/proc/stat");
+  std::string line, want = cpu < 0 ? "cpu" : "cpu" + std::to_string(cpu);
+  CpuTimes t;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    fields >> name;
+    if (name != want) {
+      continue;
+    }
+    uint64_t v[8] = {0};  // user nice system idle iowait irq softirq steal
+    for (auto& x : v) fields >> x;
+    for (auto x : v) t.total += x;
+    t.busy = t.total - v[3] - v[4];
+    t.steal = v[7];
+    break;
+  }
+  return t;
+}
+
+// "0,4" or "0-1" --> sibling CPUs other than `cpu`.
+inline std::vector<int> smt_siblings(int cpu) {
+  std::string list = read_sysfs("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+  std::vector<int> siblings;
+  std::istringstream in(list);
+  std::string part;
+  while (std::getline(in, part, ',')) {
+    if (part.empty()) continue;
+    size_t dash = part.find('-');
+    int lo = std::atoi(part.c_str());
+    int hi = dash == std::string::npos ? lo : std::atoi(part.c_str() + dash + 1);
+    for (int c = lo; c <= hi; ++c) {
+      if (c != cpu) siblings.push_back(c);
+    }
+  }
+  return siblings;
+}
+
+// Effective core clock: the add chain runs at one add per cycle.
+inline double measure_core_ghz() {
+  constexpr int iterations = 1000000;
+  double best = 0;
+  for (int i = 0; i < 5; ++i) {
+    double ns = instruction_latency<OpAdd64>(iterations);
+    best = std::max(best, iterations * static_cast<double>(kLatencyUnroll) / ns);
+  }
+  return best;
+}
+
+inline void spin_warmup(int warmup_ms) {
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(warmup_ms);
+  while (std::chrono::steady_clock::now() < until) {
+    instruction_latency<OpAdd64>(100000);
+  }
+}
+
+class HardenedEnvironment {
+public:
+  explicit HardenedEnvironment(const EnvironmentOptions& options) : options_(options) {
+    if (!options_.enabled) {
+      return;
+    }
+    cpu_ = options_.cpu;
+    if (cpu_ >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu_, &set);
+      if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "[env] sched_setaffinity(" << cpu_ << ") failed: " << std::strerror(errno) << "\n";
+      }
+      siblings_ = smt_siblings(cpu_);
+    }
+    if (options_.raise_priority && setpriority(PRIO_PROCESS, 0, -20) != 0) {
+      std::cerr << "[env] setpriority(-20) failed: " << std::strerror(errno) << "\n";
+    }
+    print_environment();
+  }
+
+  // Runs `benchmark`, bracketed by warmup and frequency / noise checks.
+  template <typename F>
+  void run(const char* name, F&& benchmark) {
+    if (!options_.enabled) {
+      benchmark();
+      return;
+    }
+    spin_warmup(options_.warmup_ms);
+    double ghz_before = measure_core_ghz();
+    CpuTimes own_before = read_cpu_times(cpu_);
+    std::vector<CpuTimes> siblings_before;
+    for (int s : siblings_) siblings_before.push_back(read_cpu_times(s));
+    rusage usage_before;
+    getrusage(RUSAGE_SELF, &usage_before);
+    auto start = std::chrono::steady_clock::now();
+
+    benchmark();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    rusage usage_after;
+    getrusage(RUSAGE_SELF, &usage_after);
+    double ghz_after = measure_core_ghz();
+    CpuTimes own_after = read_cpu_times(cpu_);
+
+    std::vector<std::string> issues;
+    double drift = std::abs(ghz_after - ghz_before) / ghz_before;
+    if (drift > options_.max_freq_drift) {
+      issues.push_back("frequency drift " + std::to_string(ghz_before) + " -> " + std::to_string(ghz_after) + " GHz");
+    }
+    // A few preemptions per second are the scheduler tick on a busy box; the
+    // run is only suspect when they come often enough to matter.
+    long involuntary = usage_after.ru_nivcsw - usage_before.ru_nivcsw;
+    double involuntary_rate = involuntary / std::max(seconds, 1e-3);
+    if (involuntary_rate > options_.max_involuntary_per_sec) {
+      issues.push_back(std::to_string(involuntary) + " involuntary context switches (" +
+                       std::to_string(involuntary_rate) + "/s)");
+    }
+    if (own_after.steal > own_before.steal) {
+      issues.push_back(std::to_string(own_after.steal - own_before.steal) + " ticks of hypervisor steal");
+    }
+    for (size_t i = 0; i < siblings_.size(); ++i) {
+      CpuTimes after = read_cpu_times(siblings_[i]);
+      uint64_t total = after.total - siblings_before[i].total;
+      double busy = total == 0 ? 0 : static_cast<double>(after.busy - siblings_before[i].busy) / total;
+      if (busy > options_.max_sibling_busy) {
+        issues.push_back("SMT sibling cpu" + std::to_string(siblings_[i]) + " busy " + std::to_string(busy * 100) + "%");
+      }
+    }
+
+    // Unpinned, there is no sibling to watch: say so rather than call it clean.
+    const char* skipped = cpu_ < 0 ? "SMT sibling check skipped (no --cpu)" : nullptr;
+    if (issues.empty() && skipped == nullptr) {
+      std::cout << "[env] " << name << ": clean (" << ghz_before << " -> " << ghz_after << " GHz)\n";
+    } else if (issues.empty()) {
+      std::cout << "[env] " << name << ": " << skipped << ", other checks clean (" << ghz_before << " -> "
+                << ghz_after << " GHz)\n";
+    } else {
+      std::cout << "[env] " << name << ": NOISY";
+      for (const auto& issue : issues) std::cout << "; " << issue;
+      if (skipped != nullptr) std::cout << "; " << skipped;
+      std::cout << "\n";
+    }
+  }
+
+private:
+  static int first_allowed_cpu() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &set)) return c;
+      }
+    }
+    return 0;
+  }
+
+  void print_environment() const {
+    int cpu = cpu_ >= 0 ? cpu_ : first_allowed_cpu();
+    std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/";
+    std::string governor = read_sysfs(base + "scaling_governor");
+    std::string no_turbo = read_sysfs("/sys/devices/system/cpu/intel_pstate/no_turbo");
+    std::string boost = read_sysfs("/sys/devices/system/cpu/cpufreq/boost");
+    if (cpu_ >= 0) {
+      std::cout << "[env] pinned to cpu" << cpu_;
+    } else {
+      std::cout << "[env] not pinned (--cpu=N to pin)";
+    }
+    std::cout << ", governor=" << (governor.empty() ? "unknown" : governor);
+    if (!no_turbo.empty()) {
+      std::cout << ", turbo=" << (no_turbo == "0" ? "on" : "off");
+    } else if (!boost.empty()) {
+      std::cout << ", turbo=" << (boost == "1" ? "on" : "off");
+    } else {
+      std::cout << ", turbo=unknown";
+    }
+    std::cout << ", smt_siblings=" << siblings_.size() << "\n";
+    if (!governor.empty() && governor != "performance") {
+      std::cout << "[env] warning: governor is '" << governor << "', numbers depend on load history\n";
+    }
+    if (no_turbo == "0" || boost == "1") {
+      std::cout << "[env] warning: turbo is on, frequency depends on temperature and active cores\n";
+    }
+  }
+
+  EnvironmentOptions options_;
+  int cpu_ = -1;  // -1: not pinned
+  std::vector<int> siblings_;
+};
+
+// --harden [--cpu=N] [--priority]
+inline EnvironmentOptions parse_environment_options(int argc, char** argv) {
+  EnvironmentOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--harden") == 0) {
+      options.enabled = true;
+    } else if (std::strncmp(argv[i], "--cpu=", 6) == 0) {
+      options.cpu = std::atoi(argv[i] + 6);
+    } else if (std::strcmp(argv[i], "--priority") == 0) {
+      options.raise_priority = true;
+    }
+  }
+  return options;
+}
+
+#endif //ENVIRONMENT_H
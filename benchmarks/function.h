@@ -1,6 +1,8 @@
 #ifndef FUNCTION_H
 #define FUNCTION_H
 
+#include "timer.h"
+
 // Regular function
 __attribute__((noinline)) int regular_add(int a, int b) {
     return a + b;
@@ -57,75 +59,61 @@ int indirect_call(FunctionPtr func, int a, int b) {
 }
 
 
+void report_call_overhead(const char* label, const Timing& t, int num_operations) {
+    double k_calls = static_cast<double>(num_operations / 1000.0);
+    cout << label << t.ns / k_calls << " ns per k_call ("
+         << t.cycles / k_calls << " cycles per k_call)\n";
+}
+
 void measure_function_call_overhead(int num_operations) {
     volatile int result = 0;
+    Stopwatch sw;
+    cout << "Clock: " << clock_backend_name(sw.backend()) << "\n";
 
     // Regular function call
-    auto start_regular = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
         result += regular_add(1, 2);
     }
-    auto end_regular = high_resolution_clock::now();
-    cout << "Regular function call: "
-         << static_cast<double>(duration_cast<nanoseconds>(end_regular - start_regular).count()) / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("Regular function call: ", sw.stop(), num_operations);
 
     // Inline function call
-    auto start_inline = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
         result += inline_add(1, 2);
     }
-    auto end_inline = high_resolution_clock::now();
-    cout << "Inline function call: "
-         << static_cast<double>(duration_cast<nanoseconds>(end_inline - start_inline).count()) / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("Inline function call: ", sw.stop(), num_operations);
 
     // Always inline function call (for GCC)
-    auto start_always_inline = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
         result += always_inline_add(1, 2);
     }
-    auto end_always_inline = high_resolution_clock::now();
-    cout << "Always inline function call (GCC): "
-         << static_cast<double>(duration_cast<nanoseconds>(end_always_inline - start_always_inline).count())
-         / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("Always inline function call (GCC): ", sw.stop(), num_operations);
 
     // Measuring indirect call overhead
-    auto start_indirect = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
       result += indirect_call(regular_add, 1, 2);
     }
-    auto end_indirect = high_resolution_clock::now();
-    cout << "Indirect function call: "
-         << static_cast<double>(duration_cast<nanoseconds>(end_indirect - start_indirect).count())
-            / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("Indirect function call: ", sw.stop(), num_operations);
 
     // Measuring virtual call overhead
     Base* obj = new Derived();
-    auto start_virtual = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
       result += obj->virtual_add(1, 2);
     }
-    auto end_virtual = high_resolution_clock::now();
-    cout << "Virtual function call: "
-         << static_cast<double>(duration_cast<nanoseconds>(end_virtual - start_virtual).count())
-            / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("Virtual function call: ", sw.stop(), num_operations);
     delete obj;
 
     // Measuring CRTP call overhead.
     CRTPDerived crtp_obj;
-    auto start_crtp = high_resolution_clock::now();
+    sw.start();
     for (int i = 0; i < num_operations; ++i) {
       result += crtp_obj.crtp_function(1, 2);
     }
-    auto end_crtp = high_resolution_clock::now();
-    cout << "CRTP function call: "
-         << static_cast<double>(duration_cast<nanoseconds>(end_crtp - start_crtp).count())
-            / static_cast<double>(num_operations/1000.0)
-         << " ns per k_call\n";
+    report_call_overhead("CRTP function call: ", sw.stop(), num_operations);
 }
 
 #endif //FUNCTION_H
@@ -0,0 +1,260 @@
+#ifndef INSTRUCTION_H
+#define INSTRUCTION_H
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <type_traits>
+#include <emmintrin.h>
+
+#include "timer.h"
+
+using namespace std;
+
+// Instruction table: every primitive gets two generated kernels.
+// - latency:    one dependency chain, op(n) consumes the result of op(n-1).
+// - throughput: kThroughputChains independent chains, limited by ports/units.
+// The hand-written loops in hardware.h mix several instruction forms in one
+// loop; here a template instantiates one kernel per instruction form instead.
+//
+// The compiler must not fold the chain (x + y + y + ... --> x + n*y), so every
+// value goes through `opaque()` once per step: an empty asm that forces the
+// value into a register without emitting an instruction.
+
+constexpr int kLatencyUnroll = 8;
+constexpr int kThroughputChains = 8;
+
+template <typename T>
+__attribute__((always_inline)) inline void opaque(T& value) {
+  if constexpr (std::is_integral<T>::value) {
+    asm volatile("" : "+r"(value));
+  } else {
+    asm volatile("" : "+x"(value));
+  }
+}
+
+// Each op: `type`, `name`, `isa` (checked with __builtin_cpu_supports),
+// `seed()` for the chain, `operand()` for the second input and `apply()`.
+// Non-baseline instructions (popcnt, fma, pmulld) are written in inline asm so
+// that the kernels need no target attribute and still run on older hosts.
+
+struct OpAdd64 {
+  using type = uint64_t;
+  static constexpr const char* name = "add r64";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return 1; }
+  static type operand() { return 1; }
+  static __attribute__((always_inline)) type apply(type x, type y) { return x + y; }
+};
+
+struct OpImul64 {
+  using type = uint64_t;
+  static constexpr const char* name = "imul r64";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return 3; }
+  static type operand() { return 7; }
+  static __attribute__((always_inline)) type apply(type x, type y) { return x * y; }
+};
+
+// Divide by 3, then OR the top dividend bit back in: the chain stays on
+// full-width dividends instead of collapsing to 0 (or to the divide-by-1
+// early-out some cores take). The row includes that 1-cycle or.
+struct OpDiv32 {
+  using type = uint32_t;
+  static constexpr const char* name = "div r32 (+or)";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return 0x7fffffffu; }
+  static type operand() { return 3; }
+  static __attribute__((always_inline)) type apply(type x, type y) { return (x / y) | 0x40000000u; }
+};
+
+struct OpDiv64 {
+  using type = uint64_t;
+  static constexpr const char* name = "div r64 (+or)";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return 0x7fffffffffffffffull; }
+  static type operand() { return 3; }
+  static __attribute__((always_inline)) type apply(type x, type y) { return (x / y) | 0x4000000000000000ull; }
+};
+
+struct OpPopcnt64 {
+  using type = uint64_t;
+  static constexpr const char* name = "popcnt r64";
+  static constexpr const char* isa = "popcnt";
+  static type seed() { return 0x5555; }
+  static type operand() { return 0; }
+  static __attribute__((always_inline)) type apply(type x, type y) {
+    type r;
+    asm("popcnt %1, %0" : "=r"(r) : "r"(x));
+    return r | y;  // y is opaque zero, keeps popcnt(popcnt(...)) from collapsing
+  }
+};
+
+// Floating-point ops use __m128d so that the scalar SSE forms are emitted
+// directly (std::sqrt would add an errno branch without -fno-math-errno).
+struct OpMulsd {
+  using type = __m128d;
+  static constexpr const char* name = "mulsd";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return _mm_set_sd(1.5); }
+  static type operand() { return _mm_set_sd(1.0000001); }
+  static __attribute__((always_inline)) type apply(type x, type y) { return _mm_mul_sd(x, y); }
+};
+
+struct OpDivsd {
+  using type = __m128d;
+  static constexpr const char* name = "divsd";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return _mm_set_sd(1.5); }
+  static type operand() { return _mm_set_sd(1.0000001); }
+  static __attribute__((always_inline)) type apply(type x, type y) { return _mm_div_sd(x, y); }
+};
+
+struct OpSqrtsd {
+  using type = __m128d;
+  static constexpr const char* name = "sqrtsd";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return _mm_set_sd(2.0); }
+  static type operand() { return _mm_set_sd(0.0); }
+  static __attribute__((always_inline)) type apply(type x, type) { return _mm_sqrt_sd(x, x); }
+};
+
+struct OpFmadd {
+  using type = __m128d;
+  static constexpr const char* name = "vfmadd231pd xmm";
+  static constexpr const char* isa = "fma";
+  static type seed() { return _mm_set1_pd(1.0); }
+  static type operand() { return _mm_set1_pd(0.9999999); }
+  static __attribute__((always_inline)) type apply(type x, type y) {
+    asm("vfmadd231pd %1, %1, %0" : "+x"(x) : "x"(y));  // x += y * y
+    return x;
+  }
+};
+
+// The one two-instruction row: a conversion changes the register file, so a
+// dependent chain needs the way back too. Numbers are for the pair
+// cvttsd2si + cvtsi2sd, not for either conversion alone.
+struct OpCvtRoundTrip {
+  using type = double;
+  static constexpr const char* name = "cvt r64<->sd (pair)";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return 3.0; }
+  static type operand() { return 0.0; }
+  static __attribute__((always_inline)) type apply(type x, type) {
+    return static_cast<double>(static_cast<int64_t>(x));
+  }
+};
+
+struct OpPaddd {
+  using type = __m128i;
+  static constexpr const char* name = "paddd xmm";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return _mm_set_epi32(4, 3, 2, 1); }
+  static type operand() { return _mm_set_epi32(8, 7, 6, 5); }
+  static __attribute__((always_inline)) type apply(type x, type y) { return _mm_add_epi32(x, y); }
+};
+
+struct OpPmulld {
+  using type = __m128i;
+  static constexpr const char* name = "pmulld xmm";
+  static constexpr const char* isa = "sse4.1";
+  static type seed() { return _mm_set_epi32(4, 3, 2, 1); }
+  static type operand() { return _mm_set_epi32(1, 1, 1, 1); }
+  static __attribute__((always_inline)) type apply(type x, type y) {
+    asm("pmulld %1, %0" : "+x"(x) : "x"(y));
+    return x;
+  }
+};
+
+struct OpPshufd {
+  using type = __m128i;
+  static constexpr const char* name = "pshufd xmm";
+  static constexpr const char* isa = "sse2";
+  static type seed() { return _mm_set_epi32(4, 3, 2, 1); }
+  static type operand() { return _mm_setzero_si128(); }
+  static __attribute__((always_inline)) type apply(type x, type) { return _mm_shuffle_epi32(x, 0x1b); }
+};
+
+// Latency: kLatencyUnroll dependent ops per iteration.
+template <typename Op>
+double instruction_latency(int num_operations) {
+  typename Op::type x = Op::seed();
+  typename Op::type y = Op::operand();
+  opaque(y);
+  Stopwatch sw;
+  sw.start();
+  for (int i = 0; i < num_operations; ++i) {
+#pragma GCC unroll 8
+    for (int u = 0; u < kLatencyUnroll; ++u) {
+      x = Op::apply(x, y);
+      opaque(x);
+    }
+  }
+  Timing t = sw.stop();
+  opaque(x);
+  return t.ns;
+}
+
+// Throughput: kThroughputChains independent ops per iteration. The chains are
+// named locals rather than an array so that they stay in registers.
+template <typename Op>
+double instruction_throughput(int num_operations) {
+  static_assert(kThroughputChains == 8, "kernel is written for 8 chains");
+  using T = typename Op::type;
+  T x0 = Op::seed(), x1 = x0, x2 = x0, x3 = x0, x4 = x0, x5 = x0, x6 = x0, x7 = x0;
+  T y = Op::operand();
+  opaque(y);
+  Stopwatch sw;
+  sw.start();
+  for (int i = 0; i < num_operations; ++i) {
+    x0 = Op::apply(x0, y); x1 = Op::apply(x1, y);
+    x2 = Op::apply(x2, y); x3 = Op::apply(x3, y);
+    x4 = Op::apply(x4, y); x5 = Op::apply(x5, y);
+    x6 = Op::apply(x6, y); x7 = Op::apply(x7, y);
+    opaque(x0); opaque(x1); opaque(x2); opaque(x3);
+    opaque(x4); opaque(x5); opaque(x6); opaque(x7);
+  }
+  Timing t = sw.stop();
+  opaque(x0); opaque(x1); opaque(x2); opaque(x3);
+  opaque(x4); opaque(x5); opaque(x6); opaque(x7);
+  return t.ns;
+}
+
+template <typename Op>
+void print_instruction_row(int num_operations, double ns_per_cycle) {
+  cout << left << setw(22) << Op::name << right;
+  if (!__builtin_cpu_supports(Op::isa)) {
+    cout << "  (skipped: no " << Op::isa << ")\n";
+    return;
+  }
+  double total = static_cast<double>(num_operations);
+  double latency = instruction_latency<Op>(num_operations) / (total * kLatencyUnroll);
+  double rthroughput = instruction_throughput<Op>(num_operations) / (total * kThroughputChains);
+  cout << fixed << setprecision(3)
+       << setw(12) << latency << setw(10) << latency / ns_per_cycle
+       << setw(12) << rthroughput << setw(10) << rthroughput / ns_per_cycle << "\n";
+  cout.unsetf(ios::floatfield);
+}
+
+template <typename... Ops>
+void print_instruction_rows(int num_operations, double ns_per_cycle) {
+  (print_instruction_row<Ops>(num_operations, ns_per_cycle), ...);
+}
+
+// uops.info style table for the host CPU. Cycles are derived from the add
+// chain, whose latency is 1 cycle on every x86 core in use today, so the
+// table does not need a frequency reading (which turbo makes unreliable).
+void test_instruction_table(int num_operations) {
+  __builtin_cpu_init();
+  double ns_per_cycle = instruction_latency<OpAdd64>(num_operations)
+                        / (static_cast<double>(num_operations) * kLatencyUnroll);
+  cout << "Reference: add r64 latency = 1 cycle = " << ns_per_cycle << " ns\n";
+  cout << left << setw(22) << "Instruction" << right
+       << setw(12) << "Lat(ns)" << setw(10) << "Lat(cyc)"
+       << setw(12) << "RThr(ns)" << setw(10) << "RThr(cyc)" << "\n";
+  print_instruction_rows<OpAdd64, OpImul64, OpDiv32, OpDiv64, OpPopcnt64,
+                         OpMulsd, OpDivsd, OpSqrtsd, OpFmadd, OpCvtRoundTrip,
+                         OpPaddd, OpPmulld, OpPshufd>(num_operations, ns_per_cycle);
+}
+
+#endif //INSTRUCTION_H
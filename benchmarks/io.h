@@ -0,0 +1,398 @@
+#ifndef IO_H
+#define IO_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifdef BENCH_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "timer.h"
+
+// File I/O engines. Loading an index is I/O bound long before it is CPU bound.
+// 1. pread: buffered, every read is a syscall plus a copy out of the page cache.
+// 2. mmap: no syscall per read, but a page fault per untouched 4K page; madvise
+//    tells the kernel whether readahead helps (SEQUENTIAL) or hurts (RANDOM).
+// 3. O_DIRECT: bypasses the page cache, buffers/offsets/sizes must be aligned.
+// 4. io_uring: O_DIRECT reads/writes kept in flight up to the queue depth from
+//    one thread (built only when CMake finds liburing).
+// The synchronous engines reach a queue depth of N with N threads, each with one
+// request in flight (fio's numjobs). Every run starts with the file dropped from
+// the page cache, and writes include the final fdatasync/msync in the total time.
+
+enum class IoEngine { Pread, Mmap, Direct, Uring };
+enum class IoDirection { Read, Write };
+enum class IoPattern { Sequential, Random };
+
+struct IoConfig {
+  IoEngine engine;
+  IoDirection direction;
+  IoPattern pattern;
+  size_t block_size;
+  unsigned queue_depth;
+};
+
+struct IoResult {
+  size_t ops = 0;
+  size_t bytes = 0;
+  double seconds = 0;
+  std::vector<uint64_t> latency_ns;  // one entry per request
+};
+
+constexpr size_t kIoAlign = 4096;  // O_DIRECT alignment for buffers, offsets and sizes
+
+inline const char* io_engine_name(IoEngine engine) {
+  switch (engine) {
+    case IoEngine::Pread: return "pread";
+    case IoEngine::Mmap: return "mmap";
+    case IoEngine::Direct: return "O_DIRECT";
+    case IoEngine::Uring: return "io_uring";
+  }
+  return "?";
+}
+
+inline bool io_engine_available(IoEngine engine) {
+#ifdef BENCH_HAVE_LIBURING
+  (void)engine;
+  return true;
+#else
+  return engine != IoEngine::Uring;
+#endif
+}
+
+[[noreturn]] inline void throw_io_error(const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+class AlignedBuffer {
+public:
+  explicit AlignedBuffer(size_t bytes) : bytes_(bytes) {
+    if (posix_memalign(&data_, kIoAlign, bytes) != 0) {
+      throw std::bad_alloc();
+    }
+    std::memset(data_, 0x5a, bytes);
+  }
+  ~AlignedBuffer() { free(data_); }
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  char* data() const { return static_cast<char*>(data_); }
+  size_t size() const { return bytes_; }
+
+private:
+  void* data_ = nullptr;
+  size_t bytes_;
+};
+
+// Scratch file filled with random bytes (no sparse or zero pages), removed on
+// destruction.
+class TempFile {
+public:
+  TempFile(const std::string& dir, size_t bytes) : path_(dir + "/bench_io_XXXXXX"), size_(bytes) {
+    int fd = mkstemp(&path_[0]);
+    if (fd < 0) {
+      throw_io_error("Failed to create " + path_);
+    }
+    std::vector<uint64_t> chunk((1 << 20) / sizeof(uint64_t));
+    std::mt19937_64 rng(71);
+    for (size_t offset = 0; offset < bytes;) {
+      for (auto& word : chunk) word = rng();
+      size_t len = std::min(bytes - offset, chunk.size() * sizeof(uint64_t));
+      ssize_t n = pwrite(fd, chunk.data(), len, static_cast<off_t>(offset));
+      if (n <= 0) {
+        ::close(fd);
+        unlink(path_.c_str());
+        throw_io_error("Failed to fill " + path_);
+      }
+      offset += static_cast<size_t>(n);
+    }
+    fsync(fd);
+    ::close(fd);
+  }
+  ~TempFile() { unlink(path_.c_str()); }
+  TempFile(const TempFile&) = delete;
+  TempFile& operator=(const TempFile&) = delete;
+
+  const std::string& path() const { return path_; }
+  size_t size() const { return size_; }
+
+private:
+  std::string path_;
+  size_t size_;
+};
+
+// Block-aligned offsets: a sequential sweep (wrapping at the end of the file)
+// or uniform random blocks.
+inline std::vector<uint64_t> io_offsets(size_t file_size, size_t block_size, size_t count, IoPattern pattern,
+                                        uint64_t seed = 72) {
+  size_t blocks = file_size / block_size;
+  std::vector<uint64_t> offsets(count);
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < count; ++i) {
+    size_t block = pattern == IoPattern::Sequential ? i % blocks : rng() % blocks;
+    offsets[i] = static_cast<uint64_t>(block) * block_size;
+  }
+  return offsets;
+}
+
+inline void drop_page_cache(int fd) {
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+// pread/pwrite the whole block; a short transfer inside the file is an error.
+inline void transfer_block(int fd, IoDirection direction, char* buffer, size_t bytes, uint64_t offset) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t n = direction == IoDirection::Read
+                    ? pread(fd, buffer + done, bytes - done, static_cast<off_t>(offset + done))
+                    : pwrite(fd, buffer + done, bytes - done, static_cast<off_t>(offset + done));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      throw_io_error(direction == IoDirection::Read ? "pread" : "pwrite");
+    }
+    done += static_cast<size_t>(n);
+  }
+}
+
+// Runs op(offset, buffer) for every offset with queue_depth threads, thread t
+// taking requests t, t + qd, t + 2qd, ...
+template <typename Op>
+IoResult run_sync_engine(const IoConfig& config, const std::vector<uint64_t>& offsets, Op&& op) {
+  unsigned threads = std::max(1u, config.queue_depth);
+  std::vector<std::vector<uint64_t>> latencies(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  auto worker = [&](unsigned t) {
+    try {
+      AlignedBuffer buffer(config.block_size);
+      latencies[t].reserve(offsets.size() / threads + 1);
+      for (size_t i = t; i < offsets.size(); i += threads) {
+        uint64_t start = monotonic_raw_ns();
+        op(offsets[i], buffer.data());
+        latencies[t].push_back(monotonic_raw_ns() - start);
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+
+  IoResult result;
+  uint64_t start = monotonic_raw_ns();
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t) workers.emplace_back(worker, t);
+  worker(0);
+  for (auto& w : workers) w.join();
+  result.seconds = (monotonic_raw_ns() - start) / 1e9;
+  for (auto& error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+  for (auto& l : latencies) result.latency_ns.insert(result.latency_ns.end(), l.begin(), l.end());
+  return result;
+}
+
+#ifdef BENCH_HAVE_LIBURING
+// One ring and queue_depth buffer slots; a completion immediately refills its
+// slot with the next request.
+inline IoResult run_uring_engine(int fd, const IoConfig& config, const std::vector<uint64_t>& offsets) {
+  unsigned depth = std::max(1u, config.queue_depth);
+  std::vector<std::unique_ptr<AlignedBuffer>> buffers;
+  for (unsigned s = 0; s < depth; ++s) buffers.emplace_back(new AlignedBuffer(config.block_size));
+  std::vector<uint64_t> submitted_at(depth);
+  std::vector<unsigned> free_slots;
+  for (unsigned s = depth; s-- > 0;) free_slots.push_back(s);
+
+  io_uring ring;
+  int rc = io_uring_queue_init(depth, &ring, 0);
+  if (rc < 0) {
+    errno = -rc;
+    throw_io_error("io_uring_queue_init");
+  }
+
+  IoResult result;
+  result.latency_ns.reserve(offsets.size());
+  size_t next = 0;
+  uint64_t start = monotonic_raw_ns();
+  try {
+    while (result.latency_ns.size() < offsets.size()) {
+      while (!free_slots.empty() && next < offsets.size()) {
+        unsigned slot = free_slots.back();
+        free_slots.pop_back();
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (config.direction == IoDirection::Read) {
+          io_uring_prep_read(sqe, fd, buffers[slot]->data(), config.block_size, offsets[next++]);
+        } else {
+          io_uring_prep_write(sqe, fd, buffers[slot]->data(), config.block_size, offsets[next++]);
+        }
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(slot)));
+        submitted_at[slot] = monotonic_raw_ns();
+      }
+      rc = io_uring_submit_and_wait(&ring, 1);
+      if (rc < 0) {
+        errno = -rc;
+        throw_io_error("io_uring_submit_and_wait");
+      }
+      io_uring_cqe* cqe;
+      while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+        unsigned slot = static_cast<unsigned>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        if (res < 0 || static_cast<size_t>(res) != config.block_size) {
+          errno = res < 0 ? -res : EIO;
+          throw_io_error("io_uring completion");
+        }
+        result.latency_ns.push_back(monotonic_raw_ns() - submitted_at[slot]);
+        free_slots.push_back(slot);
+      }
+    }
+  } catch (...) {
+    io_uring_queue_exit(&ring);
+    throw;
+  }
+  result.seconds = (monotonic_raw_ns() - start) / 1e9;
+  io_uring_queue_exit(&ring);
+  return result;
+}
+#endif
+
+inline IoResult run_io(const TempFile& file, const IoConfig& config, size_t max_ops) {
+  if (!io_engine_available(config.engine)) {
+    throw std::runtime_error("built without liburing");
+  }
+  if (config.block_size > file.size()) {
+    throw std::invalid_argument("block size larger than the file");
+  }
+  // At most one pass worth of blocks, so sequential runs never re-read a block.
+  size_t count = std::max<size_t>(1, std::min(max_ops, file.size() / config.block_size));
+  std::vector<uint64_t> offsets = io_offsets(file.size(), config.block_size, count, config.pattern);
+
+  bool direct = config.engine == IoEngine::Direct || config.engine == IoEngine::Uring;
+  int fd = ::open(file.path().c_str(), O_RDWR | (direct ? O_DIRECT : 0));
+  if (fd < 0) {
+    throw_io_error(std::string("open") + (direct ? " with O_DIRECT" : ""));
+  }
+  IoResult result;
+  try {
+    drop_page_cache(fd);
+    const IoDirection direction = config.direction;
+    switch (config.engine) {
+      case IoEngine::Pread:
+      case IoEngine::Direct:
+        result = run_sync_engine(config, offsets, [fd, direction, &config](uint64_t offset, char* buffer) {
+          transfer_block(fd, direction, buffer, config.block_size, offset);
+        });
+        break;
+      case IoEngine::Mmap: {
+        int prot = direction == IoDirection::Read ? PROT_READ : PROT_READ | PROT_WRITE;
+        void* base = mmap(nullptr, file.size(), prot, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+          throw_io_error("mmap");
+        }
+        char* bytes = static_cast<char*>(base);
+        madvise(base, file.size(), config.pattern == IoPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        try {
+          uint64_t start = monotonic_raw_ns();
+          result = run_sync_engine(config, offsets, [bytes, direction, &config](uint64_t offset, char* buffer) {
+            if (direction == IoDirection::Read) {
+              std::memcpy(buffer, bytes + offset, config.block_size);
+            } else {
+              std::memcpy(bytes + offset, buffer, config.block_size);
+            }
+          });
+          if (direction == IoDirection::Write && msync(base, file.size(), MS_SYNC) != 0) {
+            throw_io_error("msync");
+          }
+          result.seconds = (monotonic_raw_ns() - start) / 1e9;
+        } catch (...) {
+          munmap(base, file.size());
+          throw;
+        }
+        munmap(base, file.size());
+        break;
+      }
+      case IoEngine::Uring:
+#ifdef BENCH_HAVE_LIBURING
+        result = run_uring_engine(fd, config, offsets);
+#endif
+        break;
+    }
+    if (direction == IoDirection::Write && config.engine != IoEngine::Mmap) {
+      uint64_t start = monotonic_raw_ns();
+      if (fdatasync(fd) != 0) {
+        throw_io_error("fdatasync");
+      }
+      result.seconds += (monotonic_raw_ns() - start) / 1e9;
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  result.ops = offsets.size();
+  result.bytes = offsets.size() * config.block_size;
+  return result;
+}
+
+inline double latency_percentile_us(const std::vector<uint64_t>& sorted_ns, double p) {
+  if (sorted_ns.empty()) return 0;
+  size_t rank = static_cast<size_t>(p / 100.0 * (sorted_ns.size() - 1) + 0.5);
+  return sorted_ns[std::min(rank, sorted_ns.size() - 1)] / 1e3;
+}
+
+inline void report_io(const IoConfig& config, IoResult& result) {
+  std::sort(result.latency_ns.begin(), result.latency_ns.end());
+  std::cout << "  " << io_engine_name(config.engine) << " "
+            << (config.direction == IoDirection::Read ? "read" : "write") << " "
+            << (config.pattern == IoPattern::Sequential ? "seq" : "rand") << " bs="
+            << config.block_size / 1024 << "K qd=" << config.queue_depth << ": "
+            << static_cast<uint64_t>(result.ops / result.seconds) << " IOPS, "
+            << result.bytes / result.seconds / 1e9 << " GB/s, latency us p50 "
+            << latency_percentile_us(result.latency_ns, 50) << " p99 "
+            << latency_percentile_us(result.latency_ns, 99) << " p99.9 "
+            << latency_percentile_us(result.latency_ns, 99.9) << " max "
+            << (result.latency_ns.empty() ? 0 : result.latency_ns.back() / 1e3) << "\n";
+}
+
+// Every engine x direction x pattern x block size x queue depth on one scratch
+// file. The directory should be on the device under test (not tmpfs: no
+// O_DIRECT there, and "reads" never leave memory).
+void benchmark_io(const std::string& dir = "/var/tmp", size_t file_size = size_t(256) << 20,
+                  size_t max_ops = 10000) {
+  TempFile file(dir, file_size);
+  std::cout << "File I/O on " << file.path() << ", " << (file_size >> 20) << " MiB"
+            << (io_engine_available(IoEngine::Uring) ? "" : " (io_uring skipped: built without liburing)") << ":\n";
+  for (IoDirection direction : {IoDirection::Read, IoDirection::Write}) {
+    for (IoPattern pattern : {IoPattern::Sequential, IoPattern::Random}) {
+      for (size_t block_size : {size_t(4) << 10, size_t(64) << 10, size_t(1) << 20}) {
+        for (unsigned queue_depth : {1u, 4u, 32u}) {
+          for (IoEngine engine : {IoEngine::Pread, IoEngine::Mmap, IoEngine::Direct, IoEngine::Uring}) {
+            if (!io_engine_available(engine)) continue;
+            IoConfig config{engine, direction, pattern, block_size, queue_depth};
+            try {
+              IoResult result = run_io(file, config, max_ops);
+              report_io(config, result);
+            } catch (const std::exception& e) {
+              std::cout << "  " << io_engine_name(engine) << " skipped: " << e.what() << "\n";
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif //IO_H
@@ -0,0 +1,344 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <emmintrin.h>
+#include <execution>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+#include "timer.h"
+
+// C++17 并行算法: execution policy 什么时候值得用?
+// sort / reduce / transform / inclusive_scan / find on uint32_t, each under
+//   seq        std::execution::seq
+//   par        std::execution::par        (libstdc++ runs it on TBB when CMake finds TBB)
+//   par_unseq  std::execution::par_unseq
+//   SSE2       hand-written 128-bit loop, one thread (no SIMD kernel for sort)
+//   pool       the same kernel in chunks on WorkStealingPool (sort: chunk sort + merge)
+// from L1-sized to DRAM-sized inputs. The crossover line gives the smallest size
+// from which a variant is at least 5% faster than seq at every larger size
+// measured: below it the fork/join cost is larger than the work. Without TBB,
+// libstdc++ falls back to its serial backend and par / par_unseq are seq with
+// extra checks.
+//
+// Run it without `--cpu`, which pins the whole process (and TBB) to one core.
+
+#ifdef BENCH_HAVE_TBB
+constexpr const char* kParallelBackend = "TBB";
+#else
+constexpr const char* kParallelBackend = "serial (TBB not found)";
+#endif
+
+// Smallest chunk handed to the pool: below ~16K elements a task's work is in
+// the same range as spawning and stealing it.
+constexpr size_t kParallelMinGrain = 16384;
+
+inline size_t parallel_grain(const WorkStealingPool& pool, size_t n) {
+  return std::max(kParallelMinGrain, n / (pool.size() * 8));
+}
+
+// Sum mod 2^32 (what std::reduce computes for uint32_t), four accumulators to
+// hide the add latency.
+inline uint32_t reduce_sse2(const uint32_t* data, size_t n) {
+  __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    for (int k = 0; k < 4; ++k) {
+      acc[k] = _mm_add_epi32(acc[k], _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4 * k)));
+    }
+  }
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(acc[0], acc[1]), _mm_add_epi32(acc[2], acc[3]));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  uint32_t result = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+  for (; i < n; ++i) result += data[i];
+  return result;
+}
+
+// out = in * 3 + 1. SSE2 has no 32-bit mullo: x * 3 is x + (x << 1).
+inline uint32_t transform_element(uint32_t x) { return x * 3 + 1; }
+
+inline void transform_sse2(const uint32_t* in, uint32_t* out, size_t n) {
+  const __m128i one = _mm_set1_epi32(1);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    x = _mm_add_epi32(_mm_add_epi32(x, _mm_slli_epi32(x, 1)), one);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+  }
+  for (; i < n; ++i) out[i] = transform_element(in[i]);
+}
+
+// Inclusive prefix sum starting from `carry`; returns the last sum. Within a
+// register: two shift-and-add steps, then add the running carry broadcast.
+inline uint32_t inclusive_scan_sse2(const uint32_t* in, uint32_t* out, size_t n, uint32_t carry = 0) {
+  __m128i running = _mm_set1_epi32(static_cast<int>(carry));
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, running);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    running = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  carry = static_cast<uint32_t>(_mm_cvtsi128_si32(running));
+  for (; i < n; ++i) out[i] = carry += in[i];
+  return carry;
+}
+
+// Index of the first `value`, or n. 16 elements per iteration, one branch.
+inline size_t find_sse2(const uint32_t* data, size_t n, uint32_t value) {
+  const __m128i needle = _mm_set1_epi32(static_cast<int>(value));
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle),
+                     _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4)), needle)),
+        _mm_or_si128(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 8)), needle),
+                     _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12)), needle)));
+    if (_mm_movemask_epi8(hit) != 0) break;
+  }
+  for (; i < n; ++i) {
+    if (data[i] == value) return i;
+  }
+  return n;
+}
+
+inline uint32_t reduce_pool(WorkStealingPool& pool, const uint32_t* data, size_t n) {
+  return pool.parallel_reduce(
+      0, n, parallel_grain(pool, n), uint32_t(0), [&](size_t lo, size_t hi) { return reduce_sse2(data + lo, hi - lo); },
+      [](uint32_t a, uint32_t b) { return a + b; });
+}
+
+inline void transform_pool(WorkStealingPool& pool, const uint32_t* in, uint32_t* out, size_t n) {
+  pool.parallel_for(0, n, parallel_grain(pool, n), [&](size_t lo, size_t hi) { transform_sse2(in + lo, out + lo, hi - lo); });
+}
+
+// Two passes over fixed chunks: chunk sums in parallel, a serial exclusive scan
+// of the sums, then each chunk scanned in parallel from its offset. Reads the
+// input twice, so it needs two cores to break even with inclusive_scan_sse2.
+inline void inclusive_scan_pool(WorkStealingPool& pool, const uint32_t* in, uint32_t* out, size_t n) {
+  size_t grain = parallel_grain(pool, n);
+  size_t chunks = (n + grain - 1) / grain;
+  std::vector<uint32_t> offsets(chunks);
+  pool.parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+    for (size_t c = lo; c < hi; ++c) offsets[c] = reduce_sse2(in + c * grain, std::min(n, (c + 1) * grain) - c * grain);
+  });
+  uint32_t carry = 0;
+  for (uint32_t& offset : offsets) {
+    uint32_t sum = offset;
+    offset = carry;
+    carry += sum;
+  }
+  pool.parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+    for (size_t c = lo; c < hi; ++c) {
+      inclusive_scan_sse2(in + c * grain, out + c * grain, std::min(n, (c + 1) * grain) - c * grain, offsets[c]);
+    }
+  });
+}
+
+// Chunks past the best index found so far are skipped, so a hit near the front
+// stops the other workers early.
+inline size_t find_pool(WorkStealingPool& pool, const uint32_t* data, size_t n, uint32_t value) {
+  std::atomic<size_t> found{n};
+  pool.parallel_for(0, n, parallel_grain(pool, n), [&](size_t lo, size_t hi) {
+    if (lo >= found.load(std::memory_order_relaxed)) return;
+    size_t i = lo + find_sse2(data + lo, hi - lo, value);
+    if (i == hi) return;
+    size_t best = found.load(std::memory_order_relaxed);
+    while (i < best && !found.compare_exchange_weak(best, i, std::memory_order_relaxed)) {
+    }
+  });
+  return found.load();
+}
+
+// std::sort on a power-of-two number of chunks (up to one per worker, none
+// smaller than kParallelMinGrain), then
+// log2(chunks) rounds of pairwise std::merge through a scratch buffer.
+inline void sort_pool(WorkStealingPool& pool, std::vector<uint32_t>& data, std::vector<uint32_t>& scratch) {
+  size_t n = data.size();
+  size_t chunks = 1;
+  while (chunks < pool.size() && n / (chunks * 2) >= kParallelMinGrain) chunks *= 2;
+  size_t width = (n + chunks - 1) / chunks;
+  pool.parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+    for (size_t c = lo; c < hi; ++c) {
+      std::sort(data.begin() + std::min(n, c * width), data.begin() + std::min(n, (c + 1) * width));
+    }
+  });
+  scratch.resize(n);
+  std::vector<uint32_t>* from = &data;
+  std::vector<uint32_t>* to = &scratch;
+  for (; width < n; width *= 2) {
+    size_t pairs = (n + 2 * width - 1) / (2 * width);
+    pool.parallel_for(0, pairs, 1, [&](size_t lo, size_t hi) {
+      for (size_t p = lo; p < hi; ++p) {
+        size_t begin = p * 2 * width;
+        size_t mid = std::min(n, begin + width);
+        size_t end = std::min(n, begin + 2 * width);
+        std::merge(from->begin() + begin, from->begin() + mid, from->begin() + mid, from->begin() + end,
+                   to->begin() + begin);
+      }
+    });
+    std::swap(from, to);
+  }
+  if (from != &data) data.swap(scratch);
+}
+
+struct ParallelVariant {
+  const char* name;
+  std::function<uint64_t()> run;  // returns a checksum compared against seq
+};
+
+struct ParallelCase {
+  const char* algorithm;
+  // Untimed, before every call: sort reloads the input, transform and
+  // inclusive_scan clear the output.
+  std::function<void()> prepare;
+  std::vector<ParallelVariant> variants;
+};
+
+// Best single-call time: every call is timed on its own so that `prepare`
+// stays outside the measurement.
+inline double parallel_best_ns(const ParallelCase& c, const ParallelVariant& variant, size_t calls) {
+  double best = 1e30;
+  for (size_t r = 0; r < calls; ++r) {
+    c.prepare();
+    Stopwatch sw;
+    sw.start();
+    uint64_t checksum = variant.run();
+    Timing t = sw.stop();
+    volatile uint64_t sink = checksum;
+    (void)sink;
+    best = std::min(best, t.ns);
+  }
+  return best;
+}
+
+// Smallest size from which each variant is at least 5% faster than `baseline`
+// at every larger size measured (the margin keeps timing noise from
+// producing a crossover).
+inline void print_crossover(const std::vector<size_t>& sizes, const std::vector<std::vector<double>>& ns,
+                            const std::vector<ParallelVariant>& variants, size_t baseline, size_t first, size_t last) {
+  std::cout << "    crossover vs " << variants[baseline].name << ":";
+  for (size_t v = first; v < last; ++v) {
+    size_t from = sizes.size();
+    while (from > 0 && ns[from - 1][v] < 0.95 * ns[from - 1][baseline]) --from;
+    if (from == sizes.size()) {
+      std::cout << "  " << variants[v].name << " never";
+    } else {
+      std::cout << "  " << variants[v].name << " n >= " << sizes[from];
+    }
+  }
+  std::cout << "\n";
+}
+
+// Table per algorithm: µs per call for each variant and size, then the crossover
+// sizes (against seq, and for pool against the single-threaded SSE2 kernel).
+// Inputs are uniform 31-bit values; find looks for a value that is not
+// there, so every variant scans the whole input.
+void benchmark_parallel_algorithms(size_t max_elements = size_t(1) << 24,
+                                   size_t threads = std::thread::hardware_concurrency()) {
+  WorkStealingPool pool(threads);
+  std::cout << "Parallel algorithms (par backend: " << kParallelBackend << ", pool: " << pool.size()
+            << " threads, hardware: " << std::thread::hardware_concurrency() << " threads):\n";
+
+  // x4 steps from 1K, then max_elements itself.
+  std::vector<size_t> sizes;
+  for (size_t n = size_t(1) << 10; n < max_elements; n <<= 2) sizes.push_back(n);
+  sizes.push_back(max_elements);
+
+  std::vector<uint32_t> input, work, output, scratch;
+  const uint32_t kMissing = 0xffffffffu;
+  auto checksum = [&] { return output.empty() ? uint64_t(0) : (uint64_t(output.back()) << 32) ^ output[output.size() / 2]; };
+  auto sorted_checksum = [&] { return std::is_sorted(work.begin(), work.end()) ? uint64_t(work.front()) << 32 | work.back() : 0; };
+  auto nothing = [] {};
+  // Without this a variant that writes nothing would pass on the previous
+  // variant's output.
+  auto clear_output = [&] { std::fill(output.begin(), output.end(), 0); };
+
+  std::vector<ParallelCase> cases = {
+      {"sort", [&] { work = input; },
+       {{"seq", [&] { std::sort(std::execution::seq, work.begin(), work.end()); return sorted_checksum(); }},
+        {"par", [&] { std::sort(std::execution::par, work.begin(), work.end()); return sorted_checksum(); }},
+        {"par_unseq", [&] { std::sort(std::execution::par_unseq, work.begin(), work.end()); return sorted_checksum(); }},
+        {"pool", [&] { sort_pool(pool, work, scratch); return sorted_checksum(); }}}},
+      {"reduce", nothing,
+       {{"seq", [&] { return uint64_t(std::reduce(std::execution::seq, input.begin(), input.end(), uint32_t(0))); }},
+        {"par", [&] { return uint64_t(std::reduce(std::execution::par, input.begin(), input.end(), uint32_t(0))); }},
+        {"par_unseq", [&] { return uint64_t(std::reduce(std::execution::par_unseq, input.begin(), input.end(), uint32_t(0))); }},
+        {"SSE2", [&] { return uint64_t(reduce_sse2(input.data(), input.size())); }},
+        {"pool", [&] { return uint64_t(reduce_pool(pool, input.data(), input.size())); }}}},
+      {"transform", clear_output,
+       {{"seq", [&] { std::transform(std::execution::seq, input.begin(), input.end(), output.begin(), transform_element); return checksum(); }},
+        {"par", [&] { std::transform(std::execution::par, input.begin(), input.end(), output.begin(), transform_element); return checksum(); }},
+        {"par_unseq", [&] { std::transform(std::execution::par_unseq, input.begin(), input.end(), output.begin(), transform_element); return checksum(); }},
+        {"SSE2", [&] { transform_sse2(input.data(), output.data(), input.size()); return checksum(); }},
+        {"pool", [&] { transform_pool(pool, input.data(), output.data(), input.size()); return checksum(); }}}},
+      {"inclusive_scan", clear_output,
+       {{"seq", [&] { std::inclusive_scan(std::execution::seq, input.begin(), input.end(), output.begin()); return checksum(); }},
+        {"par", [&] { std::inclusive_scan(std::execution::par, input.begin(), input.end(), output.begin()); return checksum(); }},
+        {"par_unseq", [&] { std::inclusive_scan(std::execution::par_unseq, input.begin(), input.end(), output.begin()); return checksum(); }},
+        {"SSE2", [&] { inclusive_scan_sse2(input.data(), output.data(), input.size()); return checksum(); }},
+        {"pool", [&] { inclusive_scan_pool(pool, input.data(), output.data(), input.size()); return checksum(); }}}},
+      {"find", nothing,
+       {{"seq", [&] { return uint64_t(std::find(std::execution::seq, input.begin(), input.end(), kMissing) - input.begin()); }},
+        {"par", [&] { return uint64_t(std::find(std::execution::par, input.begin(), input.end(), kMissing) - input.begin()); }},
+        {"par_unseq", [&] { return uint64_t(std::find(std::execution::par_unseq, input.begin(), input.end(), kMissing) - input.begin()); }},
+        {"SSE2", [&] { return uint64_t(find_sse2(input.data(), input.size(), kMissing)); }},
+        {"pool", [&] { return uint64_t(find_pool(pool, input.data(), input.size(), kMissing)); }}}},
+  };
+
+  std::mt19937 rng(111);
+  std::streamsize precision = std::cout.precision();
+  for (const ParallelCase& c : cases) {
+    std::cout << "  " << c.algorithm << " (us per call)\n    " << std::setw(10) << "n";
+    for (const auto& variant : c.variants) std::cout << " " << std::setw(10) << variant.name;
+    std::cout << "\n";
+    std::vector<std::vector<double>> ns;
+    for (size_t n : sizes) {
+      input.resize(n);
+      for (uint32_t& x : input) x = rng() & 0x7fffffffu;
+      output.assign(n, 0);
+      size_t calls = std::max<size_t>(3, std::min<size_t>(200, (size_t(1) << 22) / n));
+      ns.emplace_back();
+      std::cout << "    " << std::setw(10) << n << std::fixed << std::setprecision(1);
+      // Every variant must leave the same result, and the same sorted or
+      // written array, as seq.
+      uint64_t expected = 0;
+      std::vector<uint32_t> expected_work, expected_output;
+      for (size_t v = 0; v < c.variants.size(); ++v) {
+        c.prepare();
+        uint64_t result = c.variants[v].run();
+        if (v == 0) {
+          expected = result;
+          expected_work = work;
+          expected_output = output;
+        } else if (result != expected || work != expected_work || output != expected_output) {
+          throw std::runtime_error(std::string(c.algorithm) + " " + c.variants[v].name + " disagrees with seq");
+        }
+        ns.back().push_back(parallel_best_ns(c, c.variants[v], calls));
+        std::cout << " " << std::setw(10) << ns.back().back() / 1e3;
+      }
+      std::cout << "\n";
+      std::cout.unsetf(std::ios::floatfield);
+      std::cout.precision(precision);
+    }
+    print_crossover(sizes, ns, c.variants, 0, 1, c.variants.size());
+    // pool runs the SSE2 kernel: this line is the threading gain alone.
+    if (c.variants.size() == 5) print_crossover(sizes, ns, c.variants, 3, 4, 5);
+  }
+}
+
+#endif //PARALLEL_H
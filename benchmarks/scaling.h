@@ -0,0 +1,179 @@
+#ifndef SCALING_H
+#define SCALING_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "hardware.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "../practices/map.h"
+
+// Scaling harness: any single-threaded kernel that can process a slice
+// [begin, end) of its items runs on 1..N threads under three schedulers:
+//   pool        WorkStealingPool::parallel_for, chunks of `grain` items
+//   thread/task one std::thread per chunk, at most N alive (create + join cost)
+//   OpenMP      `omp parallel for schedule(dynamic)` over the same chunks (when built with OpenMP)
+// speedup = serial time / parallel time, efficiency = speedup / threads.
+// 加核不一定变快: 共享同一 cache line 的写会在核之间来回传，线程越多越慢。
+// The two counter kernels do the same relaxed atomic increments, once on
+// counters every thread shares and once on a cache-line-padded slot per
+// thread: the gap between them is the cost of the line bouncing.
+
+struct ScalingKernel {
+  std::string name;
+  size_t items;
+  size_t grain;                               // items per task
+  std::function<void(size_t, size_t)> run;    // process items [begin, end)
+};
+
+inline std::vector<ScalingKernel>& scaling_kernels() {
+  static std::vector<ScalingKernel> kernels;
+  return kernels;
+}
+
+inline void register_scaling_kernel(ScalingKernel kernel) {
+  scaling_kernels().push_back(std::move(kernel));
+}
+
+// Ten counters, each on its own cache line.
+struct alignas(64) CounterLine {
+  std::atomic<int> value{0};
+};
+constexpr size_t kCountersPerSlot = 10;
+constexpr size_t kCounterSlots = 64;
+
+inline void bump_counters(CounterLine* slot, size_t items) {
+  for (size_t i = 0; i < items; ++i) {
+    for (size_t c = 0; c < kCountersPerSlot; ++c) slot[c].value.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// One slot per thread (round-robin over kCounterSlots: two threads that land
+// on the same slot share lines but never race).
+inline CounterLine* thread_counter_slot() {
+  static std::vector<CounterLine> slots(kCounterSlots * kCountersPerSlot);
+  static std::atomic<size_t> next_slot{0};
+  thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kCounterSlots;
+  return slots.data() + slot * kCountersPerSlot;
+}
+
+// hardware.h loops (each item is one loop iteration), shared vs per-thread
+// atomic counters, and CacheFriendlyMap lookups on a shared read-only map.
+inline void register_default_scaling_kernels(int num_operations) {
+  size_t items = static_cast<size_t>(num_operations);
+  size_t grain = std::max<size_t>(1, items / 1024);
+  register_scaling_kernel({"ALU (alu_operation)", items, grain,
+                           [](size_t begin, size_t end) { alu_operation(static_cast<int>(end - begin)); }});
+  register_scaling_kernel({"integer divide (integer_divide)", items, grain,
+                           [](size_t begin, size_t end) { integer_divide(static_cast<int>(end - begin)); }});
+  register_scaling_kernel({"shared counters (atomic, one copy)", items, grain, [](size_t begin, size_t end) {
+                             static std::vector<CounterLine> shared(kCountersPerSlot);
+                             bump_counters(shared.data(), end - begin);
+                           }});
+  register_scaling_kernel({"padded counters (atomic, per thread)", items, grain,
+                           [](size_t begin, size_t end) { bump_counters(thread_counter_slot(), end - begin); }});
+
+  constexpr size_t kMapKeys = 1000000;
+  WorkloadSpec spec;
+  spec.record_count = kMapKeys;
+  auto map = std::make_shared<CacheFriendlyMap<>>(kMapKeys);
+  std::vector<int> keys = WorkloadGenerator(spec).load_keys();
+  map->bulk_insert(keys, generate_random_ints(kMapKeys, 1, 1 << 20, 81));
+  auto probes = std::make_shared<std::vector<int>>(generate_random_ints(items / 10, 0, kMapKeys - 1, 82));
+  for (int& p : *probes) p = keys[p];
+  register_scaling_kernel({"map lookups (CacheFriendlyMap::find)", probes->size(), std::max<size_t>(1, probes->size() / 1024),
+                           [map, probes](size_t begin, size_t end) {
+                             long sum = 0;
+                             for (size_t i = begin; i < end; ++i) sum += map->find((*probes)[i]).value_or(0);
+                             volatile long checksum = sum;
+                             (void)checksum;
+                           }});
+}
+
+template <typename F>
+double best_seconds(int repetitions, F&& f) {
+  double best = 1e30;
+  for (int r = 0; r < repetitions; ++r) {
+    Stopwatch sw;
+    sw.start();
+    f();
+    best = std::min(best, sw.stop().ns * 1e-9);
+  }
+  return best;
+}
+
+inline void thread_per_task(const ScalingKernel& kernel, size_t threads) {
+  for (size_t wave = 0; wave < kernel.items; wave += threads * kernel.grain) {
+    std::vector<std::thread> workers;
+    for (size_t lo = wave; lo < std::min(kernel.items, wave + threads * kernel.grain); lo += kernel.grain) {
+      workers.emplace_back(kernel.run, lo, std::min(kernel.items, lo + kernel.grain));
+    }
+    for (auto& w : workers) w.join();
+  }
+}
+
+inline void report_scaling_column(const char* label, double serial, double seconds, size_t threads) {
+  double speedup = serial / seconds;
+  std::cout << ", " << label << " " << speedup << "x (" << static_cast<int>(speedup / threads * 100) << "%)";
+}
+
+inline void run_scaling(const ScalingKernel& kernel, size_t max_threads, bool pin) {
+  constexpr int kRepetitions = 3;
+  double serial = best_seconds(kRepetitions, [&] { kernel.run(0, kernel.items); });
+  std::cout << "  " << kernel.name << ": serial " << serial * 1e3 << " ms, " << kernel.items << " items, grain "
+            << kernel.grain << "\n";
+  for (size_t threads = 1; threads <= max_threads;
+       threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+    std::cout << "    " << threads << " threads: speedup (efficiency)";
+    {
+      WorkStealingPool pool(threads, pin);
+      double t = best_seconds(kRepetitions, [&] { pool.parallel_for(0, kernel.items, kernel.grain, kernel.run); });
+      report_scaling_column("pool", serial, t, threads);
+    }
+    report_scaling_column("thread/task", serial,
+                          best_seconds(kRepetitions, [&] { thread_per_task(kernel, threads); }), threads);
+#ifdef _OPENMP
+    double omp_seconds = best_seconds(kRepetitions, [&] {
+      long chunks = static_cast<long>((kernel.items + kernel.grain - 1) / kernel.grain);
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+      for (long c = 0; c < chunks; ++c) {
+        size_t lo = static_cast<size_t>(c) * kernel.grain;
+        kernel.run(lo, std::min(kernel.items, lo + kernel.grain));
+      }
+    });
+    report_scaling_column("OpenMP", serial, omp_seconds, threads);
+#endif
+    std::cout << "\n";
+  }
+}
+
+// Every registered kernel (the defaults when none are registered) on 1, 2, 4,
+// ... max_threads threads.
+void benchmark_scaling(int num_operations = 100000000, size_t max_threads = std::thread::hardware_concurrency(),
+                       bool pin = true) {
+  if (scaling_kernels().empty()) {
+    register_default_scaling_kernels(num_operations);
+  }
+  max_threads = std::max<size_t>(1, max_threads);
+  std::cout << "Scaling on 1.." << max_threads << " threads"
+#ifndef _OPENMP
+            << " (OpenMP column skipped: built without OpenMP)"
+#endif
+            << ":\n";
+  for (const auto& kernel : scaling_kernels()) {
+    run_scaling(kernel, max_threads, pin);
+  }
+}
+
+#endif //SCALING_H
@@ -0,0 +1,363 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sched.h>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+// Work-stealing scheduler.
+// 每个 worker 有自己的 deque: 自己从底部 push/pop (LIFO, 缓存是热的)，
+// 空闲的 worker 从别人的顶部偷 (FIFO, 偷到的是最大的那块任务)。
+// Owner operations touch only `bottom_`, so the common path has no contended
+// atomics; the only CAS is on `top_`, between thieves and a pop of the last element.
+
+// Chase-Lev deque, with the C11 memory orderings of Lê et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (PPoPP'13). T must be
+// lock-free atomic (a pointer). The array grows by doubling; retired arrays are
+// kept until destruction because a thief may still be reading one.
+template <typename T>
+class ChaseLevDeque {
+public:
+  explicit ChaseLevDeque(int64_t capacity = 256) : array_(new Array(capacity)) {
+    retired_.emplace_back(array_.load(std::memory_order_relaxed));
+  }
+
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  // Owner only.
+  void push(T item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only.
+  bool pop(T& item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    item = a->get(b);
+    if (t == b) {
+      // Last element: race the thieves for it.
+      bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread. Fails when empty or when it loses a race.
+  bool steal(T& item) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    Array* a = array_.load(std::memory_order_acquire);
+    T candidate = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return false;
+    }
+    item = candidate;
+    return true;
+  }
+
+  bool empty() const {
+    return top_.load(std::memory_order_relaxed) >= bottom_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Array {
+    explicit Array(int64_t n) : capacity(n), slots(new std::atomic<T>[n]) {}
+    T get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+    void put(int64_t i, T item) { slots[i & (capacity - 1)].store(item, std::memory_order_relaxed); }
+
+    int64_t capacity;  // power of two
+    std::unique_ptr<std::atomic<T>[]> slots;
+  };
+
+  Array* grow(Array* old, int64_t t, int64_t b) {
+    Array* bigger = new Array(old->capacity * 2);
+    for (int64_t i = t; i < b; ++i) bigger->put(i, old->get(i));
+    retired_.emplace_back(bigger);
+    array_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Array*> array_;
+  std::vector<std::unique_ptr<Array>> retired_;  // owner only
+};
+
+// A batch of tasks the spawning thread waits for.
+class TaskGroup {
+public:
+  void add(size_t n = 1) { outstanding_.fetch_add(n, std::memory_order_relaxed); }
+  void done() { outstanding_.fetch_sub(1, std::memory_order_release); }
+  bool finished() const { return outstanding_.load(std::memory_order_acquire) == 0; }
+
+private:
+  std::atomic<size_t> outstanding_{0};
+};
+
+// num_threads participants: worker 0 is the thread that constructs the pool and
+// calls parallel_for/parallel_reduce (it runs tasks while it waits), workers
+// 1..n-1 are background threads. With `pin`, worker i is bound to the i-th CPU
+// of the inherited affinity mask, so a rerun puts the same work on the same core.
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(size_t num_threads = std::thread::hardware_concurrency(), bool pin = false)
+      : num_threads_(std::max<size_t>(1, num_threads)) {
+    for (size_t i = 0; i < num_threads_; ++i) {
+      workers_.emplace_back(new Worker());
+    }
+    CPU_ZERO(&owner_affinity_);
+    if (pin && sched_getaffinity(0, sizeof(owner_affinity_), &owner_affinity_) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &owner_affinity_)) cpus_.push_back(cpu);
+      }
+    }
+    owner_pool_ = current_pool();
+    owner_index_ = current_index();
+    bind_current_thread(0);
+    for (size_t i = 1; i < num_threads_; ++i) {
+      threads_.emplace_back([this, i] {
+        bind_current_thread(i);
+        worker_loop(i);
+      });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_.store(true);
+    }
+    sleep_cv_.notify_all();
+    for (auto& t : threads_) t.join();
+    Task* task;
+    for (auto& worker : workers_) {
+      while (worker->deque.pop(task)) delete task;
+      for (Task* t : worker->inbox) delete t;
+    }
+    if (current_pool() == this) {
+      current_pool() = owner_pool_;
+      current_index() = owner_index_;
+      if (!cpus_.empty()) sched_setaffinity(0, sizeof(owner_affinity_), &owner_affinity_);
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  size_t size() const { return num_threads_; }
+
+  // Index of the calling worker, or size() for a thread outside the pool.
+  size_t current_worker() const { return current_pool() == this ? current_index() : num_threads_; }
+
+  // From a worker: push onto its own deque. From outside, or with an explicit
+  // affinity, go through the target worker's inbox; idle workers still steal
+  // the task if its target is busy.
+  void spawn(Task task, size_t affinity = SIZE_MAX) {
+    Task* heap_task = new Task(std::move(task));
+    size_t self = current_worker();
+    if (affinity == SIZE_MAX && self < num_threads_) {
+      workers_[self]->deque.push(heap_task);
+    } else {
+      size_t target = affinity != SIZE_MAX ? affinity % num_threads_
+                                           : next_inbox_.fetch_add(1, std::memory_order_relaxed) % num_threads_;
+      std::lock_guard<std::mutex> lock(workers_[target]->inbox_mutex);
+      workers_[target]->inbox.push_back(heap_task);
+    }
+    pending_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.notify_one();
+    }
+  }
+
+  // Run tasks until the group is finished.
+  void wait(const TaskGroup& group) {
+    size_t self = current_worker();
+    while (!group.finished()) {
+      if (!run_one(self)) _mm_pause();
+    }
+  }
+
+  // body(lo, hi) over [begin, end) in chunks of at most `grain`. The range is
+  // split in halves: the upper half is spawned, the lower one kept, so thieves
+  // take the biggest remaining pieces and the owner walks memory in order.
+  template <typename F>
+  void parallel_for(size_t begin, size_t end, size_t grain, F&& body) {
+    if (begin >= end) return;
+    grain = std::max<size_t>(1, grain);
+    TaskGroup group;
+    std::function<void(size_t, size_t)> split = [&](size_t lo, size_t hi) {
+      while (hi - lo > grain) {
+        size_t mid = lo + (hi - lo) / 2;
+        group.add();
+        spawn([&split, &group, mid, hi] {
+          split(mid, hi);
+          group.done();
+        });
+        hi = mid;
+      }
+      body(lo, hi);
+    };
+    split(begin, end);
+    wait(group);
+  }
+
+  // Reduction over [begin, end): map(lo, hi) per chunk, folded with combine into
+  // one cache-line-padded accumulator per worker, then across workers. combine
+  // must be associative and commutative (chunks finish in any order).
+  template <typename T, typename Map, typename Combine>
+  T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Combine&& combine) {
+    struct alignas(64) Partial {
+      T value;
+    };
+    std::vector<Partial> partials(num_threads_ + 1, Partial{identity});
+    std::mutex outside_mutex;  // for chunks run by threads outside the pool
+    parallel_for(begin, end, grain, [&](size_t lo, size_t hi) {
+      T chunk = map(lo, hi);
+      size_t slot = current_worker();
+      if (slot == num_threads_) {
+        std::lock_guard<std::mutex> lock(outside_mutex);
+        partials[slot].value = combine(partials[slot].value, chunk);
+      } else {
+        partials[slot].value = combine(partials[slot].value, chunk);
+      }
+    });
+    T result = identity;
+    for (const auto& partial : partials) result = combine(result, partial.value);
+    return result;
+  }
+
+private:
+  struct Worker {
+    ChaseLevDeque<Task*> deque;
+    std::mutex inbox_mutex;
+    std::deque<Task*> inbox;
+    std::minstd_rand rng{std::random_device{}()};
+  };
+
+  static WorkStealingPool*& current_pool() {
+    thread_local WorkStealingPool* pool = nullptr;
+    return pool;
+  }
+  static size_t& current_index() {
+    thread_local size_t index = 0;
+    return index;
+  }
+
+  void bind_current_thread(size_t index) {
+    current_pool() = this;
+    current_index() = index;
+    if (!cpus_.empty()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus_[index % cpus_.size()], &set);
+      sched_setaffinity(0, sizeof(set), &set);
+    }
+  }
+
+  Task* take_from_inbox(size_t index) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.inbox_mutex);
+    if (worker.inbox.empty()) return nullptr;
+    Task* task = worker.inbox.front();
+    worker.inbox.pop_front();
+    return task;
+  }
+
+  // Own deque, own inbox, then one pass over the others starting at a random
+  // victim (their deques, then their inboxes).
+  bool run_one(size_t self) {
+    Task* task = nullptr;
+    bool found = false;
+    if (self < num_threads_) {
+      found = workers_[self]->deque.pop(task) || (task = take_from_inbox(self)) != nullptr;
+    }
+    if (!found) {
+      size_t start = self < num_threads_ ? workers_[self]->rng() : next_inbox_.load(std::memory_order_relaxed);
+      for (size_t k = 0; k < num_threads_ && !found; ++k) {
+        size_t victim = (start + k) % num_threads_;
+        if (victim != self) found = workers_[victim]->deque.steal(task);
+      }
+      for (size_t k = 0; k < num_threads_ && !found; ++k) {
+        size_t victim = (start + k) % num_threads_;
+        if (victim != self) found = (task = take_from_inbox(victim)) != nullptr;
+      }
+    }
+    if (!found) return false;
+    pending_.fetch_sub(1);
+    (*task)();
+    delete task;
+    return true;
+  }
+
+  void worker_loop(size_t self) {
+    constexpr int kSpinsBeforeSleep = 2048;
+    int idle = 0;
+    while (!stop_.load(std::memory_order_relaxed)) {
+      if (run_one(self)) {
+        idle = 0;
+        continue;
+      }
+      if (++idle < kSpinsBeforeSleep) {
+        _mm_pause();
+        continue;
+      }
+      // pending_ and sleeping_ are seq_cst: a spawner either sees us sleeping
+      // and notifies, or we see its pending task and do not sleep.
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleeping_.fetch_add(1);
+      sleep_cv_.wait(lock, [this] { return stop_.load() || pending_.load() > 0; });
+      sleeping_.fetch_sub(1);
+      idle = 0;
+    }
+  }
+
+  size_t num_threads_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::vector<int> cpus_;  // empty: not pinned
+  cpu_set_t owner_affinity_;  // restored on the owner thread by the destructor
+  WorkStealingPool* owner_pool_ = nullptr;
+  size_t owner_index_ = 0;
+  std::atomic<size_t> next_inbox_{0};
+  std::atomic<int64_t> pending_{0};  // spawned, not yet started
+  std::atomic<int> sleeping_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,178 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cpuid.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <x86intrin.h>
+
+// Pluggable clock layer.
+// high_resolution_clock::now() goes through vDSO clock_gettime: ~20 ns per call
+// on our VMs, which is larger than the thing measured in "ns per k_call" for
+// inline calls. The TSC backend reads the time stamp counter directly:
+//   start: lfence; rdtsc; lfence   --> earlier instructions retired, later ones not started
+//   stop:  rdtscp; lfence          --> rdtscp waits for the timed code, lfence fences what follows
+// TSC ticks are reference cycles (nominal frequency), not core cycles: turbo and
+// power states change the core clock but not the TSC.
+
+enum class ClockBackend { Chrono, Tsc };
+
+struct Timing {
+  double ns = 0;
+  double cycles = 0;  // TSC reference cycles, 0 when the TSC is not calibrated
+};
+
+struct TscCalibration {
+  bool rdtscp = false;
+  bool invariant = false;        // CPUID.80000007H:EDX[8], constant rate across P/C states
+  double ns_per_tick = 0;        // against CLOCK_MONOTONIC_RAW (not NTP slewed)
+  double overhead_ticks = 0;     // empty start()/stop() pair
+  double chrono_overhead_ns = 0; // empty now()/now() pair
+};
+
+__attribute__((always_inline)) inline uint64_t tsc_start() {
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+}
+
+__attribute__((always_inline)) inline uint64_t tsc_stop() {
+  unsigned aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+}
+
+inline uint64_t monotonic_raw_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+inline TscCalibration calibrate_tsc() {
+  TscCalibration c;
+  unsigned eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) {
+    c.rdtscp = edx & (1u << 27);
+  }
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    c.invariant = edx & (1u << 8);
+  }
+
+  // Chrono overhead is needed by the fallback path even without a TSC.
+  double best = 1e18;
+  for (int i = 0; i < 1000; ++i) {
+    auto a = std::chrono::high_resolution_clock::now();
+    auto b = std::chrono::high_resolution_clock::now();
+    best = std::min(best, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count()));
+  }
+  c.chrono_overhead_ns = best;
+  if (!c.rdtscp) {
+    return c;
+  }
+
+  // Three 20 ms windows, keep the median ratio.
+  double ratios[3];
+  for (double& ratio : ratios) {
+    uint64_t n0 = monotonic_raw_ns(), t0 = tsc_start();
+    uint64_t n1 = n0, t1 = t0;
+    while (n1 - n0 < 20000000ull) {
+      n1 = monotonic_raw_ns();
+      t1 = tsc_stop();
+    }
+    ratio = static_cast<double>(n1 - n0) / static_cast<double>(t1 - t0);
+  }
+  std::sort(ratios, ratios + 3);
+  c.ns_per_tick = ratios[1];
+
+  uint64_t overhead = UINT64_MAX;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t a = tsc_start();
+    uint64_t b = tsc_stop();
+    overhead = std::min(overhead, b - a);
+  }
+  c.overhead_ticks = static_cast<double>(overhead);
+  return c;
+}
+
+inline const TscCalibration& tsc_calibration() {
+  static const TscCalibration calibration = calibrate_tsc();
+  return calibration;
+}
+
+// BENCH_CLOCK=chrono|tsc overrides the choice; otherwise the TSC is used only
+// when it is invariant, since a TSC that stops in C-states is not a clock.
+inline ClockBackend default_clock_backend() {
+  const TscCalibration& c = tsc_calibration();
+  const char* env = std::getenv("BENCH_CLOCK");
+  if (env != nullptr && std::strcmp(env, "chrono") == 0) {
+    return ClockBackend::Chrono;
+  }
+  if (env != nullptr && std::strcmp(env, "tsc") == 0 && c.rdtscp) {
+    return ClockBackend::Tsc;
+  }
+  return (c.rdtscp && c.invariant) ? ClockBackend::Tsc : ClockBackend::Chrono;
+}
+
+inline const char* clock_backend_name(ClockBackend backend) {
+  return backend == ClockBackend::Tsc ? "tsc (rdtscp/lfence)" : "chrono (high_resolution_clock)";
+}
+
+// Stopwatch with the timer's own overhead subtracted. Every timed region goes
+// through it except the original hardware.h, allocation.h and
+// benchmark_map / benchmark_map_random loops: they run for milliseconds, where
+// the 20 ns now() cost is noise, and keep their chrono code unchanged.
+class Stopwatch {
+public:
+  explicit Stopwatch(ClockBackend backend = default_clock_backend())
+      : backend_(backend), calibration_(tsc_calibration()) {}
+
+  __attribute__((always_inline)) void start() {
+    if (backend_ == ClockBackend::Tsc) {
+      begin_ticks_ = tsc_start();
+    } else {
+      begin_time_ = std::chrono::high_resolution_clock::now();
+    }
+  }
+
+  __attribute__((always_inline)) Timing stop() {
+    Timing t;
+    if (backend_ == ClockBackend::Tsc) {
+      uint64_t end = tsc_stop();
+      t.cycles = std::max(0.0, static_cast<double>(end - begin_ticks_) - calibration_.overhead_ticks);
+      t.ns = t.cycles * calibration_.ns_per_tick;
+    } else {
+      auto end = std::chrono::high_resolution_clock::now();
+      double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin_time_).count());
+      t.ns = std::max(0.0, ns - calibration_.chrono_overhead_ns);
+      t.cycles = calibration_.ns_per_tick > 0 ? t.ns / calibration_.ns_per_tick : 0;
+    }
+    return t;
+  }
+
+  ClockBackend backend() const { return backend_; }
+
+private:
+  ClockBackend backend_;
+  const TscCalibration& calibration_;
+  uint64_t begin_ticks_ = 0;
+  std::chrono::high_resolution_clock::time_point begin_time_;
+};
+
+inline void print_timer_info() {
+  const TscCalibration& c = tsc_calibration();
+  std::cout << "Clock backend: " << clock_backend_name(default_clock_backend()) << "\n";
+  std::cout << "TSC: rdtscp=" << c.rdtscp << " invariant=" << c.invariant;
+  if (c.ns_per_tick > 0) {
+    std::cout << " freq=" << 1.0 / c.ns_per_tick << " GHz overhead=" << c.overhead_ticks << " ticks";
+  }
+  std::cout << "\nChrono overhead: " << c.chrono_overhead_ns << " ns\n";
+}
+
+#endif //TIMER_H
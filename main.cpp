@@ -1,17 +1,50 @@
 #include "./benchmarks/allocation.h"
 #include "./benchmarks/hardware.h"
 #include "./benchmarks/function.h"
+#include "./benchmarks/instruction.h"
+#include "./benchmarks/timer.h"
+#include "./benchmarks/environment.h"
+#include "./benchmarks/io.h"
+#include "./benchmarks/scaling.h"
+#include "./benchmarks/container.h"
+#include "./benchmarks/copy.h"
+#include "./benchmarks/parallel.h"
 #include "./practices/map.h"
+#include "./practices/lsm_map.h"
+#include "./practices/compressed_map.h"
+#include "./practices/snapshot.h"
+#include "./practices/kv_service.h"
+#include "./practices/layout.h"
 
 using namespace std;
 using namespace std::chrono;
 
 // Main function
-int main() {
+// ./cplusplus_efficiency [--harden [--cpu=N] [--priority]]
+int main(int argc, char** argv) {
   constexpr int num_operations = 100000000;
-//  test_all_hardware_related(num_operations);
-  measure_function_call_overhead(num_operations);
-//  test_allocation(num_operations);
-//  benchmark_map();
+  HardenedEnvironment env(parse_environment_options(argc, argv));
+  print_timer_info();
+//  env.run("hardware", [&] { test_all_hardware_related(num_operations); });
+//  env.run("instruction table", [&] { test_instruction_table(num_operations / 10); });
+  env.run("function call", [&] { measure_function_call_overhead(num_operations); });
+//  env.run("allocation", [&] { test_allocation(num_operations); });
+//  env.run("map", [&] { benchmark_map(); });
+//  env.run("map ycsb", [&] { benchmark_map_ycsb(); });
+//  env.run("map range scan", [&] { benchmark_map_range_scan(); });
+//  env.run("lsm ingest", [&] { benchmark_lsm_ingest(); });
+//  env.run("compressed keys", [&] { benchmark_compressed_keys(); });
+//  env.run("snapshot", [&] { benchmark_snapshot(); });
+//  env.run("parallel bulk insert", [&] { benchmark_parallel_bulk_insert(); });
+//  env.run("map miss ratio", [&] { benchmark_map_miss_ratio(); });
+//  env.run("map types", [&] { benchmark_map_types(); });
+//  env.run("file io", [&] { benchmark_io(); });
+//  env.run("scaling", [&] { benchmark_scaling(num_operations); });
+//  env.run("containers", [&] { benchmark_containers(); });
+//  env.run("copy move", [&] { benchmark_copy_move(); });
+//  env.run("map latency", [&] { benchmark_map_latency(); });
+//  env.run("kv service", [&] { benchmark_kv_service(); });
+//  env.run("layouts", [&] { benchmark_layouts(); });
+//  env.run("parallel algorithms", [&] { benchmark_parallel_algorithms(); });
   return 0;
 }
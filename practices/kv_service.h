@@ -0,0 +1,676 @@
+#ifndef KV_SERVICE_H
+#define KV_SERVICE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+#include "latency.h"
+#include "map.h"
+
+// [客户端] ----- [服务端]: map.h 开头讲的是服务端，这里把 map 放到一个真正的服务后面测。
+// Loopback key-value service in front of a CacheFriendlyMap, plus a load generator.
+//
+// Protocol: fixed 16-byte frames in host byte order (loopback only).
+//   request  {op, key, value, id}      op = Get | Put
+//   response {status, value, id}       in request order per connection
+// Clients pipeline (up to `depth` requests in flight per connection) and batch
+// (`batch` requests per send). The server handles whatever complete frames one
+// read returned as one batch: one lock acquisition and one send for all of them.
+//
+// Server: an acceptor thread hands connections round-robin to `threads` worker
+// event loops (thread per core, each with its own epoll). Gets take the map's
+// shared lock, a batch with any Put takes it exclusively.
+//
+// Load generator:
+//   closed loop  each connection keeps `depth` requests outstanding; throughput
+//                is whatever the service sustains, latency includes queueing
+//                behind the connection's own requests.
+//   open loop    requests are scheduled at a fixed rate whether or not earlier
+//                ones returned, and latency is measured from the scheduled send
+//                time, so a stalled server cannot hide its queueing delay
+//                (no coordinated omission).
+
+enum class KvTransport { Unix, Tcp };
+
+enum class KvOp : uint8_t { Get = 1, Put = 2 };
+
+enum class KvStatus : uint8_t { Ok = 0, NotFound = 1, BadRequest = 2 };
+
+struct KvRequest {
+    KvOp op;
+    uint8_t reserved[3];
+    int32_t key;
+    int32_t value;
+    uint32_t id;
+};
+static_assert(sizeof(KvRequest) == 16, "KvRequest is one 16-byte frame");
+
+struct KvResponse {
+    KvStatus status;
+    uint8_t reserved[3];
+    int32_t value;
+    uint32_t id;
+    uint32_t reserved2;
+};
+static_assert(sizeof(KvResponse) == 16, "KvResponse is one 16-byte frame");
+
+struct KvEndpoint {
+    KvTransport transport = KvTransport::Unix;
+    std::string path;   // Unix
+    uint16_t port = 0;  // Tcp, on 127.0.0.1
+};
+
+inline const char* kv_transport_name(KvTransport transport) {
+    return transport == KvTransport::Unix ? "unix socket" : "tcp loopback";
+}
+
+[[noreturn]] inline void throw_socket_error(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Blocking client socket.
+inline int connect_kv(const KvEndpoint& endpoint) {
+    int fd;
+    if (endpoint.transport == KvTransport::Unix) {
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw_socket_error("socket");
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, endpoint.path.c_str(), sizeof(addr.sun_path) - 1);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            throw_socket_error("connect " + endpoint.path);
+        }
+    } else {
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) throw_socket_error("socket");
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(endpoint.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            throw_socket_error("connect 127.0.0.1:" + std::to_string(endpoint.port));
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // small frames: no Nagle delay
+    }
+    return fd;
+}
+
+inline void send_all(int fd, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_socket_error("send");
+        }
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+}
+
+class KvServer {
+public:
+    KvServer(CacheFriendlyMap<>& map, KvEndpoint endpoint, size_t threads = std::thread::hardware_concurrency())
+        : map_(map), endpoint_(std::move(endpoint)) {
+        listen_fd_ = open_listener();
+        threads = std::max<size_t>(1, threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+            Worker& worker = *workers_.back();
+            worker.epoll_fd = epoll_create1(0);
+            worker.wake_fd = eventfd(0, EFD_NONBLOCK);
+            if (worker.epoll_fd < 0 || worker.wake_fd < 0) {
+                shutdown();
+                throw_socket_error("epoll/eventfd");
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;  // the wake-up eventfd
+            epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.wake_fd, &event);
+        }
+        for (auto& worker : workers_) {
+            Worker* w = worker.get();
+            w->thread = std::thread([this, w] { run_worker(*w); });
+        }
+        acceptor_ = std::thread([this] { run_acceptor(); });
+    }
+
+    ~KvServer() { shutdown(); }
+
+    KvServer(const KvServer&) = delete;
+    KvServer& operator=(const KvServer&) = delete;
+
+    // Port is filled in for Tcp (bound to an ephemeral port when 0).
+    const KvEndpoint& endpoint() const { return endpoint_; }
+
+    // Requests served and reads they arrived in: requests / reads is the
+    // average server-side batch.
+    uint64_t requests() const { return sum_counter(&Worker::requests); }
+    uint64_t reads() const { return sum_counter(&Worker::reads); }
+
+private:
+    struct Connection {
+        int fd;
+        std::vector<char> in;   // unparsed bytes [0, in_length)
+        size_t in_length = 0;
+        std::vector<char> out;  // unsent responses [out_offset, out.size())
+        size_t out_offset = 0;
+        bool waiting_for_write = false;  // registered for EPOLLOUT instead of EPOLLIN
+    };
+
+    struct Worker {
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        std::thread thread;
+        std::mutex pending_mutex;
+        std::vector<int> pending;  // accepted, not yet registered
+        std::unordered_set<Connection*> connections;
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> reads{0};
+    };
+
+    static constexpr size_t kReadChunk = 64 * 1024;
+
+    int open_listener() {
+        int fd;
+        if (endpoint_.transport == KvTransport::Unix) {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) throw_socket_error("socket");
+            ::unlink(endpoint_.path.c_str());
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, endpoint_.path.c_str(), sizeof(addr.sun_path) - 1);
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                ::close(fd);
+                throw_socket_error("bind " + endpoint_.path);
+            }
+        } else {
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0) throw_socket_error("socket");
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(endpoint_.port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(addr);
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+                || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+                ::close(fd);
+                throw_socket_error("bind 127.0.0.1:" + std::to_string(endpoint_.port));
+            }
+            endpoint_.port = ntohs(addr.sin_port);
+        }
+        if (::listen(fd, SOMAXCONN) != 0) {
+            ::close(fd);
+            throw_socket_error("listen");
+        }
+        return fd;
+    }
+
+    void run_acceptor() {
+        for (size_t next = 0;; ++next) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;  // listener shut down
+            }
+            if (endpoint_.transport == KvTransport::Tcp) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            Worker& worker = *workers_[next % workers_.size()];
+            {
+                std::lock_guard<std::mutex> lock(worker.pending_mutex);
+                worker.pending.push_back(fd);
+            }
+            uint64_t one = 1;
+            (void)::write(worker.wake_fd, &one, sizeof(one));
+        }
+    }
+
+    void run_worker(Worker& worker) {
+        epoll_event events[64];
+        while (!stopping_.load(std::memory_order_acquire)) {
+            int n = epoll_wait(worker.epoll_fd, events, 64, -1);
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; ++i) {
+                auto* connection = static_cast<Connection*>(events[i].data.ptr);
+                if (connection == nullptr) {
+                    adopt_pending(worker);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    if (!flush(worker, *connection)) continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    handle_readable(worker, *connection);
+                }
+            }
+        }
+        for (Connection* connection : worker.connections) {
+            ::close(connection->fd);
+            delete connection;
+        }
+        worker.connections.clear();
+    }
+
+    void adopt_pending(Worker& worker) {
+        uint64_t counter;
+        (void)::read(worker.wake_fd, &counter, sizeof(counter));
+        std::vector<int> fds;
+        {
+            std::lock_guard<std::mutex> lock(worker.pending_mutex);
+            fds.swap(worker.pending);
+        }
+        for (int fd : fds) {
+            auto* connection = new Connection{fd, std::vector<char>(kReadChunk), 0, {}, 0, false};
+            worker.connections.insert(connection);
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = connection;
+            epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    void close_connection(Worker& worker, Connection& connection) {
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        ::close(connection.fd);
+        worker.connections.erase(&connection);
+        delete &connection;
+    }
+
+    // One read per wake-up (level-triggered), so a busy connection cannot
+    // starve the others on this worker.
+    void handle_readable(Worker& worker, Connection& connection) {
+        if (connection.in.size() - connection.in_length < kReadChunk) {
+            connection.in.resize(connection.in_length + kReadChunk);
+        }
+        ssize_t n = ::recv(connection.fd, connection.in.data() + connection.in_length,
+                           connection.in.size() - connection.in_length, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            close_connection(worker, connection);
+            return;
+        }
+        if (n < 0) return;
+        connection.in_length += static_cast<size_t>(n);
+        size_t frames = connection.in_length / sizeof(KvRequest);
+        if (frames == 0) return;
+        serve_batch(connection, frames);
+        worker.requests.fetch_add(frames, std::memory_order_relaxed);
+        worker.reads.fetch_add(1, std::memory_order_relaxed);
+        size_t consumed = frames * sizeof(KvRequest);
+        std::memmove(connection.in.data(), connection.in.data() + consumed, connection.in_length - consumed);
+        connection.in_length -= consumed;
+        flush(worker, connection);
+    }
+
+    void serve_batch(Connection& connection, size_t frames) {
+        const char* in = connection.in.data();
+        size_t first = connection.out.size();
+        connection.out.resize(first + frames * sizeof(KvResponse));
+        char* out = connection.out.data() + first;
+        bool writes = false;
+        for (size_t i = 0; i < frames; ++i) {
+            KvOp op;
+            std::memcpy(&op, in + i * sizeof(KvRequest), sizeof(op));
+            writes |= op == KvOp::Put;
+        }
+        auto serve = [&] {
+            for (size_t i = 0; i < frames; ++i) {
+                KvRequest request;
+                std::memcpy(&request, in + i * sizeof(KvRequest), sizeof(request));
+                KvResponse response{};
+                response.id = request.id;
+                if (request.op == KvOp::Get) {
+                    response.status = map_.try_get(request.key, response.value) ? KvStatus::Ok : KvStatus::NotFound;
+                } else if (request.op == KvOp::Put) {
+                    map_.insert(request.key, request.value);
+                    response.status = KvStatus::Ok;
+                } else {
+                    response.status = KvStatus::BadRequest;
+                }
+                std::memcpy(out + i * sizeof(KvResponse), &response, sizeof(response));
+            }
+        };
+        if (writes) {
+            std::unique_lock<std::shared_mutex> lock(map_mutex_);
+            serve();
+        } else {
+            std::shared_lock<std::shared_mutex> lock(map_mutex_);
+            serve();
+        }
+    }
+
+    // Returns false if the connection was closed. While responses are pending
+    // the connection waits for EPOLLOUT only: no new requests are read until
+    // the client drains its responses (backpressure).
+    bool flush(Worker& worker, Connection& connection) {
+        while (connection.out_offset < connection.out.size()) {
+            ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_offset,
+                               connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) break;
+                close_connection(worker, connection);
+                return false;
+            }
+            connection.out_offset += static_cast<size_t>(n);
+        }
+        bool blocked = connection.out_offset < connection.out.size();
+        if (!blocked) {
+            connection.out.clear();
+            connection.out_offset = 0;
+        }
+        if (blocked != connection.waiting_for_write) {
+            epoll_event event{};
+            event.events = blocked ? EPOLLOUT : EPOLLIN;
+            event.data.ptr = &connection;
+            epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.waiting_for_write = blocked;
+        }
+        return true;
+    }
+
+    uint64_t sum_counter(std::atomic<uint64_t> Worker::*counter) const {
+        uint64_t total = 0;
+        for (const auto& worker : workers_) total += ((*worker).*counter).load(std::memory_order_relaxed);
+        return total;
+    }
+
+    void shutdown() {
+        stopping_.store(true, std::memory_order_release);
+        if (listen_fd_ >= 0) {
+            ::shutdown(listen_fd_, SHUT_RDWR);  // wakes accept()
+        }
+        if (acceptor_.joinable()) acceptor_.join();
+        for (auto& worker : workers_) {
+            if (worker->wake_fd >= 0) {
+                uint64_t one = 1;
+                (void)::write(worker->wake_fd, &one, sizeof(one));
+            }
+            if (worker->thread.joinable()) worker->thread.join();
+            for (int fd : worker->pending) ::close(fd);
+            if (worker->epoll_fd >= 0) ::close(worker->epoll_fd);
+            if (worker->wake_fd >= 0) ::close(worker->wake_fd);
+        }
+        workers_.clear();
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            if (endpoint_.transport == KvTransport::Unix) ::unlink(endpoint_.path.c_str());
+        }
+    }
+
+    CacheFriendlyMap<>& map_;
+    std::shared_mutex map_mutex_;
+    KvEndpoint endpoint_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::thread acceptor_;
+};
+
+struct KvLoadOptions {
+    size_t connections = 4;
+    size_t depth = 1;           // closed loop: requests in flight per connection
+    size_t batch = 1;           // closed loop: requests per send
+    double seconds = 1.0;
+    double read_ratio = 0.95;   // the rest are Puts of existing keys
+    const std::vector<int>* keys = nullptr;
+};
+
+struct KvLoadResult {
+    uint64_t requests = 0;
+    double ops_per_second = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+};
+
+inline KvRequest make_kv_request(std::mt19937_64& rng, const KvLoadOptions& options, uint32_t id) {
+    const std::vector<int>& keys = *options.keys;
+    KvRequest request{};
+    request.op = std::uniform_real_distribution<double>(0, 1)(rng) < options.read_ratio ? KvOp::Get : KvOp::Put;
+    request.key = keys[rng() % keys.size()];
+    request.value = static_cast<int32_t>(id);
+    request.id = id;
+    return request;
+}
+
+// Reads whatever responses arrived (at least one frame) into `buffer`; returns
+// the number of complete responses and keeps a partial frame for next time.
+// Returns 0 when the server closed the connection.
+inline size_t receive_responses(int fd, std::vector<char>& buffer, size_t& length, std::vector<KvResponse>& out) {
+    out.clear();
+    while (out.empty()) {
+        ssize_t n = ::recv(fd, buffer.data() + length, buffer.size() - length, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_socket_error("recv");
+        }
+        if (n == 0) return 0;
+        length += static_cast<size_t>(n);
+        size_t frames = length / sizeof(KvResponse);
+        out.resize(frames);
+        std::memcpy(out.data(), buffer.data(), frames * sizeof(KvResponse));
+        std::memmove(buffer.data(), buffer.data() + frames * sizeof(KvResponse), length - frames * sizeof(KvResponse));
+        length -= frames * sizeof(KvResponse);
+    }
+    return out.size();
+}
+
+inline KvLoadResult summarize_load(std::vector<std::unique_ptr<LatencyHistogram>>& histograms, double seconds) {
+    LatencyHistogram merged;
+    for (const auto& histogram : histograms) histogram->merge_into(merged);
+    KvLoadResult result;
+    result.requests = merged.count();
+    result.ops_per_second = seconds > 0 ? merged.count() / seconds : 0;
+    result.p50_us = merged.percentile(0.5) / 1e3;
+    result.p99_us = merged.percentile(0.99) / 1e3;
+    result.p999_us = merged.percentile(0.999) / 1e3;
+    result.max_us = merged.max() / 1e3;
+    return result;
+}
+
+// Closed loop: each connection refills to `depth` outstanding requests in
+// sends of `batch` requests. Latencies are in ns.
+inline KvLoadResult run_closed_loop(const KvEndpoint& endpoint, const KvLoadOptions& options) {
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    for (size_t c = 0; c < options.connections; ++c) histograms.push_back(std::make_unique<LatencyHistogram>());
+    uint64_t start = monotonic_raw_ns();
+    uint64_t deadline = start + static_cast<uint64_t>(options.seconds * 1e9);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < options.connections; ++c) {
+        clients.emplace_back([&, c] {
+            int fd = connect_kv(endpoint);
+            size_t depth = std::max<size_t>(1, options.depth);
+            size_t batch = std::clamp<size_t>(options.batch, 1, depth);
+            size_t ring = 1;
+            while (ring < depth) ring <<= 1;
+            std::vector<uint64_t> sent_at(ring);
+            std::vector<KvRequest> requests(batch);
+            std::vector<char> buffer(64 * 1024);
+            size_t buffered = 0;
+            std::vector<KvResponse> responses;
+            std::mt19937_64 rng(1000 + c);
+            uint32_t next_id = 0;
+            uint32_t done = 0;
+            LatencyHistogram& histogram = *histograms[c];
+            while (true) {
+                uint64_t now = monotonic_raw_ns();
+                while (now < deadline && next_id - done + batch <= depth) {
+                    for (auto& request : requests) {
+                        sent_at[next_id & (ring - 1)] = now;
+                        request = make_kv_request(rng, options, next_id++);
+                    }
+                    send_all(fd, requests.data(), requests.size() * sizeof(KvRequest));
+                }
+                if (next_id == done) break;
+                if (receive_responses(fd, buffer, buffered, responses) == 0) break;
+                now = monotonic_raw_ns();
+                for (const KvResponse& response : responses) {
+                    histogram.record(now - sent_at[response.id & (ring - 1)]);
+                    ++done;
+                }
+            }
+            ::close(fd);
+        });
+    }
+    for (auto& client : clients) client.join();
+    return summarize_load(histograms, (monotonic_raw_ns() - start) / 1e9);
+}
+
+// Open loop at `rate` requests/s over all connections. Each connection has a
+// sender thread on a fixed schedule (requests that fell due while it slept
+// leave in one send) and a receiver thread that measures from the scheduled
+// time. The sender half-closes the socket when done, so the receiver sees EOF
+// after the last response.
+inline KvLoadResult run_open_loop(const KvEndpoint& endpoint, const KvLoadOptions& options, double rate) {
+    constexpr size_t kRing = size_t(1) << 16;  // max requests in flight per connection
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    for (size_t c = 0; c < options.connections; ++c) histograms.push_back(std::make_unique<LatencyHistogram>());
+    double interval_ns = 1e9 * options.connections / rate;
+    uint64_t start = monotonic_raw_ns() + 1000000;  // 1 ms to connect
+    uint64_t end = start + static_cast<uint64_t>(options.seconds * 1e9);
+    std::atomic<uint64_t> last_response{start};
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c] {
+            int fd = connect_kv(endpoint);
+            auto scheduled = std::make_unique<std::atomic<uint64_t>[]>(kRing);
+            std::atomic<uint64_t> received{0};
+            std::thread receiver([&] {
+                std::vector<char> buffer(64 * 1024);
+                size_t buffered = 0;
+                std::vector<KvResponse> responses;
+                LatencyHistogram& histogram = *histograms[c];
+                while (receive_responses(fd, buffer, buffered, responses) > 0) {
+                    uint64_t now = monotonic_raw_ns();
+                    for (const KvResponse& response : responses) {
+                        uint64_t due = scheduled[response.id & (kRing - 1)].load(std::memory_order_relaxed);
+                        histogram.record(now > due ? now - due : 0);
+                    }
+                    received.fetch_add(responses.size(), std::memory_order_release);
+                    uint64_t seen = last_response.load(std::memory_order_relaxed);
+                    while (seen < now && !last_response.compare_exchange_weak(seen, now)) {}
+                }
+            });
+
+            std::mt19937_64 rng(2000 + c);
+            std::vector<KvRequest> requests;
+            // Stagger the connections across one interval.
+            double next_due = start + interval_ns * c / options.connections;
+            uint32_t id = 0;
+            while (next_due < end) {
+                uint64_t now = monotonic_raw_ns();
+                if (now < next_due) {
+                    uint64_t wait = static_cast<uint64_t>(next_due) - now;
+                    if (wait > 50000) {
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(wait - 50000));
+                    } else {
+                        std::this_thread::yield();  // too short to sleep accurately
+                    }
+                    continue;
+                }
+                requests.clear();
+                while (next_due <= now && next_due < end && requests.size() < 64) {
+                    while (id - received.load(std::memory_order_acquire) >= kRing) std::this_thread::yield();
+                    scheduled[id & (kRing - 1)].store(static_cast<uint64_t>(next_due), std::memory_order_relaxed);
+                    requests.push_back(make_kv_request(rng, options, id++));
+                    next_due += interval_ns;
+                }
+                send_all(fd, requests.data(), requests.size() * sizeof(KvRequest));
+            }
+            ::shutdown(fd, SHUT_WR);
+            receiver.join();
+            ::close(fd);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    return summarize_load(histograms, (last_response.load() - start) / 1e9);
+}
+
+inline void print_kv_load(const std::string& label, const KvLoadResult& result, double server_batch) {
+    std::cout << "    " << label << ": " << result.ops_per_second / 1e3 << " kops/s, p50 " << result.p50_us
+              << " us, p99 " << result.p99_us << " us, p99.9 " << result.p999_us << " us, max " << result.max_us
+              << " us, server batch " << server_batch << "\n";
+}
+
+// Throughput vs latency for the service in front of a CacheFriendlyMap of
+// `num_keys` keys, over each transport: a closed-loop sweep of pipeline depth,
+// then open-loop rates from 25% to 125% of the best closed-loop throughput.
+void benchmark_kv_service(size_t num_keys = 1000000, double seconds_per_point = 1.0, size_t connections = 4,
+                          size_t server_threads = std::thread::hardware_concurrency(),
+                          const std::string& unix_path = "/tmp/cache_friendly_map.sock") {
+    WorkloadSpec spec;
+    spec.record_count = num_keys;
+    std::vector<int> keys = WorkloadGenerator(spec).load_keys();
+    CacheFriendlyMap<> map(num_keys);
+    map.bulk_insert(keys, generate_random_ints(num_keys, 1, 1 << 20, 91));
+
+    KvLoadOptions options;
+    options.connections = connections;
+    options.seconds = seconds_per_point;
+    options.keys = &keys;
+
+    for (KvTransport transport : {KvTransport::Unix, KvTransport::Tcp}) {
+        KvEndpoint endpoint;
+        endpoint.transport = transport;
+        endpoint.path = unix_path;
+        KvServer server(map, endpoint, server_threads);
+        std::cout << "KV service over " << kv_transport_name(transport) << ", " << std::max<size_t>(1, server_threads)
+                  << " server threads, " << connections << " connections, " << num_keys << " keys, "
+                  << options.read_ratio * 100 << "% gets:\n";
+        auto measure = [&server](auto&& run) {
+            uint64_t requests = server.requests(), reads = server.reads();
+            KvLoadResult result = run();
+            uint64_t served = server.requests() - requests, batches = server.reads() - reads;
+            return std::make_pair(result, batches > 0 ? static_cast<double>(served) / batches : 0.0);
+        };
+
+        std::cout << "  closed loop (depth = requests in flight per connection):\n";
+        double peak = 0;
+        for (size_t depth : {1, 4, 16, 64}) {
+            options.depth = depth;
+            options.batch = std::min<size_t>(depth, 16);
+            auto [result, batch] = measure([&] { return run_closed_loop(server.endpoint(), options); });
+            peak = std::max(peak, result.ops_per_second);
+            print_kv_load("depth " + std::to_string(depth) + ", batch " + std::to_string(options.batch), result, batch);
+        }
+
+        std::cout << "  open loop (target rate --> achieved):\n";
+        for (double fraction : {0.25, 0.5, 0.75, 0.9, 1.0, 1.25}) {
+            double rate = std::max(1000.0, peak * fraction);
+            auto [result, batch] = measure([&] { return run_open_loop(server.endpoint(), options, rate); });
+            print_kv_load("target " + std::to_string(static_cast<int>(rate / 1e3)) + " kops/s", result, batch);
+        }
+    }
+}
+
+#endif //KV_SERVICE_H
@@ -0,0 +1,264 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <x86intrin.h>
+
+#include "../benchmarks/timer.h"
+
+// 尾延迟: 10000 次操作的总时间看不出 p99。
+// Per-operation latency recorder that can stay compiled into the maps.
+//
+// LatencyHistogram is HDR-style log-linear: values below 64 get exact buckets;
+// above that every power of two is split into kSubBuckets linear buckets, so a
+// reported percentile is at most 1/32 (~3%) above the true value, from 1 tick to
+// 2^64 ticks, in 1920 counters.
+//
+// Each thread records into its own shard (one writer per shard, so a record is
+// a plain load + store, no lock prefix and no shared cache line). summary()
+// merges the shards with relaxed loads and may run while threads record.
+// Values are raw TSC ticks (rdtsc without fences); they are converted to ns
+// with the calibration from timer.h when exported.
+//
+// The rdtsc pair is the expensive part, not the histogram: on our VMs each read
+// is ~25 ns and it stops the core from overlapping one lookup's cache misses with
+// the next lookup's, so a fully timed CacheFriendlyMap::get runs at its latency
+// instead of its throughput. set_sample_period(N) times one operation in N per
+// thread; the rest pay a counter increment and a predictable branch.
+
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBuckets = (65 - kSubBucketBits) * kSubBuckets;
+
+    static size_t bucket_index(uint64_t value) {
+        int exponent = 63 - __builtin_clzll(value | 1);
+        int shift = std::max(0, exponent - kSubBucketBits);
+        return (static_cast<size_t>(shift) << kSubBucketBits) + static_cast<size_t>(value >> shift);
+    }
+
+    // Largest value that maps to `index`.
+    static uint64_t bucket_upper(size_t index) {
+        if (index < 2 * kSubBuckets) {
+            return index;
+        }
+        size_t shift = (index >> kSubBucketBits) - 1;
+        uint64_t mantissa = index - (shift << kSubBucketBits);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    // Owner thread only: true for one call in `period` (a power of two).
+    __attribute__((always_inline)) bool sample(uint64_t period) {
+        return (calls_++ & (period - 1)) == 0;
+    }
+
+    // Single writer only.
+    __attribute__((always_inline)) void record(uint64_t value) {
+        auto& bucket = counts_[bucket_index(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_.store(total_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void merge_into(LatencyHistogram& out) const {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            uint64_t count = counts_[i].load(std::memory_order_relaxed);
+            if (count != 0) out.counts_[i].store(out.counts_[i].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        }
+        out.total_.store(out.total_.load(std::memory_order_relaxed) + total_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        out.max_.store(std::max(out.max_.load(std::memory_order_relaxed), max_.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    // Not safe against a concurrent writer: reset only while no thread records.
+    void reset() {
+        for (auto& count : counts_) count.store(0, std::memory_order_relaxed);
+        total_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Smallest bucket bound with at least quantile * count() values at or below it.
+    uint64_t percentile(double quantile) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * static_cast<double>(total) + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(bucket_upper(i), max());
+            }
+        }
+        return max();
+    }
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> max_{0};
+    uint64_t calls_ = 0;  // sample() counter, owner thread only
+};
+
+struct LatencySummary {
+    uint64_t count = 0;  // timed operations (every sample_period-th one)
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double p999_ns = 0;
+    double max_ns = 0;
+    size_t threads = 0;  // shards merged
+};
+
+// One histogram shard per recording thread. A thread finds its shard through a
+// small thread_local cache keyed by recorder id (ids are never reused, so a
+// destroyed recorder's entries simply stop matching); a miss takes the mutex
+// once to look up or create the shard for this thread.
+class LatencyRecorder {
+public:
+    LatencyRecorder() : id_(next_id()) {}
+    LatencyRecorder(const LatencyRecorder&) = delete;
+    LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+    __attribute__((always_inline)) void record(uint64_t ticks) { local().record(ticks); }
+
+    // This thread's shard if the next operation is to be timed, else nullptr.
+    __attribute__((always_inline)) LatencyHistogram* sample() {
+        LatencyHistogram& shard = local();
+        return shard.sample(sample_period_.load(std::memory_order_relaxed)) ? &shard : nullptr;
+    }
+
+    // Time one operation in `period` per thread (rounded up to a power of two).
+    void set_sample_period(uint64_t period) {
+        uint64_t rounded = 1;
+        while (rounded < period) rounded <<= 1;
+        sample_period_.store(rounded, std::memory_order_relaxed);
+    }
+
+    uint64_t sample_period() const { return sample_period_.load(std::memory_order_relaxed); }
+
+    LatencySummary summary() const {
+        LatencyHistogram merged;
+        LatencySummary summary;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& shard : shards_) {
+                if (shard.histogram->count() == 0) continue;
+                shard.histogram->merge_into(merged);
+                ++summary.threads;
+            }
+        }
+        // Without an rdtscp-capable TSC there is no calibration: report ticks.
+        double ns_per_tick = tsc_calibration().ns_per_tick > 0 ? tsc_calibration().ns_per_tick : 1.0;
+        summary.count = merged.count();
+        summary.p50_ns = merged.percentile(0.5) * ns_per_tick;
+        summary.p99_ns = merged.percentile(0.99) * ns_per_tick;
+        summary.p999_ns = merged.percentile(0.999) * ns_per_tick;
+        summary.max_ns = merged.max() * ns_per_tick;
+        return summary;
+    }
+
+    // Only while no thread records.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& shard : shards_) shard.histogram->reset();
+    }
+
+private:
+    struct Shard {
+        std::thread::id owner;
+        std::unique_ptr<LatencyHistogram> histogram;
+    };
+
+    struct CacheEntry {
+        uint64_t id = 0;
+        LatencyHistogram* histogram = nullptr;
+    };
+
+    static constexpr size_t kCachedRecorders = 4;
+
+    struct ThreadCache {
+        CacheEntry entries[kCachedRecorders];
+        size_t next = 0;  // round-robin victim
+    };
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> counter{0};
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    __attribute__((always_inline)) LatencyHistogram& local() {
+        static thread_local ThreadCache cache;
+        for (const CacheEntry& entry : cache.entries) {
+            if (entry.id == id_) return *entry.histogram;
+        }
+        return attach(cache);
+    }
+
+    __attribute__((noinline)) LatencyHistogram& attach(ThreadCache& cache) {
+        std::thread::id self = std::this_thread::get_id();
+        LatencyHistogram* histogram = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& shard : shards_) {
+                // A reused thread id belongs to a thread that has exited: still one writer.
+                if (shard.owner == self) histogram = shard.histogram.get();
+            }
+            if (histogram == nullptr) {
+                shards_.push_back({self, std::make_unique<LatencyHistogram>()});
+                histogram = shards_.back().histogram.get();
+            }
+        }
+        cache.entries[cache.next] = {id_, histogram};
+        cache.next = (cache.next + 1) % kCachedRecorders;
+        return *histogram;
+    }
+
+    uint64_t id_;
+    std::atomic<uint64_t> sample_period_{1};
+    mutable std::mutex mutex_;
+    std::vector<Shard> shards_;
+};
+
+// Stand-in when instrumentation is compiled out: no state, no code.
+struct NoLatencyRecorder {};
+
+template <bool Enabled>
+using LatencyRecorderFor = std::conditional_t<Enabled, LatencyRecorder, NoLatencyRecorder>;
+
+// Times its own lifetime, so early returns and exceptions are recorded too.
+template <typename Recorder>
+class ScopedLatency {
+public:
+    __attribute__((always_inline)) explicit ScopedLatency(Recorder& recorder)
+        : shard_(recorder.sample()), start_(shard_ != nullptr ? __rdtsc() : 0) {}
+    __attribute__((always_inline)) ~ScopedLatency() {
+        if (shard_ != nullptr) shard_->record(__rdtsc() - start_);
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyHistogram* shard_;
+    uint64_t start_;
+};
+
+template <>
+class ScopedLatency<NoLatencyRecorder> {
+public:
+    explicit ScopedLatency(NoLatencyRecorder&) {}
+};
+
+#endif //LATENCY_H
@@ -0,0 +1,391 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <emmintrin.h>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "map.h"
+
+// 数据布局: KeyValue 的 alignas(64) 把 8 字节的数据撑成一整条 cache line,
+// CacheFriendlyMap 用的是 SoA (keys_ / values_)。到底哪个好，量一下。
+//   AoS packed   {key, value} x n                8 B per element
+//   AoS padded   KeyValue (map.h) x n            64 B per element, one per cache line
+//   SoA          keys[n], values[n]              what CacheFriendlyMap does
+//   AoSoA        {keys[8], values[8]} x n/8      one cache line per 8 elements (2 SSE2 compares)
+//
+// Every kernel takes a Touch policy: NoTouch for the timed run, LineTouch to
+// count the distinct cache lines the same code path reads or writes. That count
+// x 64 is the "bytes touched" column: what the layout costs in memory traffic,
+// independent of how well the prefetcher hides it.
+
+struct NoTouch {
+    __attribute__((always_inline)) void operator()(const void*, size_t) {}
+};
+
+struct LineTouch {
+    std::unordered_set<uintptr_t> lines;
+
+    void operator()(const void* p, size_t bytes) {
+        uintptr_t first = reinterpret_cast<uintptr_t>(p) / 64;
+        uintptr_t last = (reinterpret_cast<uintptr_t>(p) + bytes - 1) / 64;
+        for (uintptr_t line = first; line <= last; ++line) lines.insert(line);
+    }
+
+    size_t bytes() const { return lines.size() * 64; }
+};
+
+// Plain halving lower_bound over an index, so every layout runs the same search.
+template <typename KeyAt, typename Touch>
+size_t layout_lower_bound(size_t n, int key, KeyAt key_at, Touch& touch) {
+    size_t first = 0;
+    while (n > 0) {
+        size_t half = n / 2;
+        const int& probe = key_at(first + half);
+        touch(&probe, sizeof(int));
+        if (probe < key) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return first;
+}
+
+struct PackedKeyValue {
+    int key, value;
+    bool operator<(const PackedKeyValue& other) const { return key < other.key; }
+};
+
+// AoS over PackedKeyValue (8 B) or KeyValue (64 B).
+template <typename Element>
+class AosLayout {
+public:
+    void load(const std::vector<int>& keys, const std::vector<int>& values) {
+        data_.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            data_[i].key = keys[i];
+            data_[i].value = values[i];
+        }
+    }
+
+    void sort() { std::sort(data_.begin(), data_.end()); }
+
+    // Sort working set per element: the elements themselves.
+    static constexpr size_t sort_bytes_per_element() { return sizeof(Element); }
+
+    template <typename Touch>
+    int search(int key, Touch& touch) const {
+        size_t i = layout_lower_bound(data_.size(), key, [this](size_t j) -> const int& { return data_[j].key; }, touch);
+        if (i < data_.size() && data_[i].key == key) {
+            touch(&data_[i].value, sizeof(int));
+            return data_[i].value;
+        }
+        return 0;
+    }
+
+    template <typename Touch>
+    long scan(int lo, int hi, Touch& touch) const {
+        long sum = 0;
+        for (const Element& e : data_) {
+            touch(&e.key, sizeof(int));
+            if (e.key >= lo && e.key <= hi) {
+                touch(&e.value, sizeof(int));
+                sum += e.value;
+            }
+        }
+        return sum;
+    }
+
+    template <typename Touch>
+    void update(Touch& touch) {
+        for (Element& e : data_) {
+            touch(&e.value, sizeof(int));
+            e.value = e.value * 3 + 1;
+        }
+    }
+
+    bool sorted() const { return std::is_sorted(data_.begin(), data_.end()); }
+
+private:
+    std::vector<Element> data_;
+};
+
+class SoaLayout {
+public:
+    void load(const std::vector<int>& keys, const std::vector<int>& values) {
+        keys_ = keys;
+        values_ = values;
+    }
+
+    // As CacheFriendlyMap::bulk_insert: sort an index by key, then gather.
+    void sort() {
+        std::vector<uint32_t> order(keys_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return keys_[a] < keys_[b]; });
+        std::vector<int> keys(keys_.size()), values(values_.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            keys[i] = keys_[order[i]];
+            values[i] = values_[order[i]];
+        }
+        keys_.swap(keys);
+        values_.swap(values);
+    }
+
+    // keys + values, the index, and the gathered copies.
+    static constexpr size_t sort_bytes_per_element() { return 2 * sizeof(int) + sizeof(uint32_t) + 2 * sizeof(int); }
+
+    template <typename Touch>
+    int search(int key, Touch& touch) const {
+        size_t i = layout_lower_bound(keys_.size(), key, [this](size_t j) -> const int& { return keys_[j]; }, touch);
+        if (i < keys_.size() && keys_[i] == key) {
+            touch(&values_[i], sizeof(int));
+            return values_[i];
+        }
+        return 0;
+    }
+
+    template <typename Touch>
+    long scan(int lo, int hi, Touch& touch) const {
+        long sum = 0;
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            touch(&keys_[i], sizeof(int));
+            if (keys_[i] >= lo && keys_[i] <= hi) {
+                touch(&values_[i], sizeof(int));
+                sum += values_[i];
+            }
+        }
+        return sum;
+    }
+
+    template <typename Touch>
+    void update(Touch& touch) {
+        for (int& value : values_) {
+            touch(&value, sizeof(int));
+            value = value * 3 + 1;
+        }
+    }
+
+    bool sorted() const { return std::is_sorted(keys_.begin(), keys_.end()); }
+
+private:
+    std::vector<int> keys_;
+    std::vector<int> values_;
+};
+
+// Blocks of kLanes keys followed by their kLanes values: one 64-byte line. The
+// last block is padded with INT_MAX keys.
+class AosoaLayout {
+public:
+    static constexpr size_t kLanes = 8;
+
+    struct alignas(64) Block {
+        int keys[kLanes];
+        int values[kLanes];
+    };
+    static_assert(sizeof(Block) == 64, "one block per cache line");
+
+    void load(const std::vector<int>& keys, const std::vector<int>& values) {
+        size_ = keys.size();
+        blocks_.assign((size_ + kLanes - 1) / kLanes, Block{});
+        for (size_t i = 0; i < blocks_.size() * kLanes; ++i) {
+            blocks_[i / kLanes].keys[i % kLanes] = i < size_ ? keys[i] : INT_MAX;
+            blocks_[i / kLanes].values[i % kLanes] = i < size_ ? values[i] : 0;
+        }
+    }
+
+    // No in-place sort across blocks: unpack to pairs, sort, repack.
+    void sort() {
+        std::vector<PackedKeyValue> pairs(size_);
+        for (size_t i = 0; i < size_; ++i) pairs[i] = {blocks_[i / kLanes].keys[i % kLanes], blocks_[i / kLanes].values[i % kLanes]};
+        std::sort(pairs.begin(), pairs.end());
+        for (size_t i = 0; i < size_; ++i) {
+            blocks_[i / kLanes].keys[i % kLanes] = pairs[i].key;
+            blocks_[i / kLanes].values[i % kLanes] = pairs[i].value;
+        }
+    }
+
+    // The blocks and the unpacked pairs.
+    static constexpr size_t sort_bytes_per_element() { return sizeof(Block) / kLanes + sizeof(PackedKeyValue); }
+
+    // Binary search over each block's last key, then count the keys below
+    // `key` inside the block with two SSE2 compares.
+    template <typename Touch>
+    int search(int key, Touch& touch) const {
+        size_t b = layout_lower_bound(blocks_.size(), key,
+                                      [this](size_t j) -> const int& { return blocks_[j].keys[kLanes - 1]; }, touch);
+        if (b == blocks_.size()) {
+            return 0;
+        }
+        const Block& block = blocks_[b];
+        touch(block.keys, sizeof(block.keys));
+        __m128i needle = _mm_set1_epi32(key);
+        __m128i lo = _mm_cmplt_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(block.keys)), needle);
+        __m128i hi = _mm_cmplt_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(block.keys + 4)), needle);
+        int lane = __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4));
+        if (lane < static_cast<int>(kLanes) && block.keys[lane] == key && b * kLanes + lane < size_) {
+            touch(&block.values[lane], sizeof(int));
+            return block.values[lane];
+        }
+        return 0;
+    }
+
+    template <typename Touch>
+    long scan(int lo, int hi, Touch& touch) const {
+        long sum = 0;
+        for (size_t i = 0; i < size_; ++i) {
+            const Block& block = blocks_[i / kLanes];
+            touch(&block.keys[i % kLanes], sizeof(int));
+            if (block.keys[i % kLanes] >= lo && block.keys[i % kLanes] <= hi) {
+                touch(&block.values[i % kLanes], sizeof(int));
+                sum += block.values[i % kLanes];
+            }
+        }
+        return sum;
+    }
+
+    template <typename Touch>
+    void update(Touch& touch) {
+        for (Block& block : blocks_) {
+            touch(block.values, sizeof(block.values));
+            for (int& value : block.values) value = value * 3 + 1;
+        }
+    }
+
+    bool sorted() const {
+        for (size_t i = 1; i < size_; ++i) {
+            if (blocks_[i / kLanes].keys[i % kLanes] < blocks_[(i - 1) / kLanes].keys[(i - 1) % kLanes]) return false;
+        }
+        return true;
+    }
+
+private:
+    std::vector<Block> blocks_;
+    size_t size_ = 0;
+};
+
+struct LayoutCosts {
+    double search_ns = 0, search_bytes = 0;  // per lookup
+    double scan_ns = 0, scan_bytes = 0;      // per element of one full pass
+    double update_ns = 0, update_bytes = 0;  // per element of one full pass
+    double sort_ns = 0, sort_bytes = 0;      // per element, bytes = working set
+};
+
+template <typename F>
+double layout_ns(F&& f) {
+    Stopwatch sw;
+    sw.start();
+    f();
+    return sw.stop().ns;
+}
+
+// keys: sorted and unique; shuffled_*: the same pairs in random order.
+template <typename Layout>
+LayoutCosts measure_layout(const std::vector<int>& keys, const std::vector<int>& values,
+                           const std::vector<int>& shuffled_keys, const std::vector<int>& shuffled_values,
+                           const std::vector<int>& probes) {
+    constexpr size_t kCountedProbes = 1000;
+    LayoutCosts costs;
+    Layout layout;
+    layout.load(keys, values);
+    NoTouch none;
+    volatile long checksum = 0;
+    long sum = 0;
+    size_t n = keys.size();
+
+    costs.search_ns = layout_ns([&] {
+        for (int key : probes) sum += layout.search(key, none);
+    }) / probes.size();
+    size_t counted = 0;
+    for (size_t i = 0; i < std::min(kCountedProbes, probes.size()); ++i, ++counted) {
+        LineTouch touched;
+        sum += layout.search(probes[i], touched);
+        costs.search_bytes += touched.bytes();
+    }
+    costs.search_bytes /= counted;
+
+    // ~10% of the keys, a contiguous run since the keys are sorted.
+    int lo = keys[n * 45 / 100];
+    int hi = keys[n * 55 / 100];
+    sum += layout.scan(lo, hi, none);  // warm up
+    costs.scan_ns = layout_ns([&] { sum += layout.scan(lo, hi, none); }) / n;
+    LineTouch scanned;
+    sum += layout.scan(lo, hi, scanned);
+    costs.scan_bytes = static_cast<double>(scanned.bytes()) / n;
+
+    costs.update_ns = layout_ns([&] { layout.update(none); }) / n;
+    LineTouch updated;
+    layout.update(updated);
+    costs.update_bytes = static_cast<double>(updated.bytes()) / n;
+
+    layout.load(shuffled_keys, shuffled_values);
+    costs.sort_ns = layout_ns([&] { layout.sort(); }) / n;
+    costs.sort_bytes = Layout::sort_bytes_per_element();
+    if (!layout.sorted()) {
+        throw std::runtime_error("layout sort produced an unsorted array");
+    }
+    checksum += sum;
+    return costs;
+}
+
+inline void print_layout_costs(const char* label, const LayoutCosts& c) {
+    std::streamsize precision = std::cout.precision();
+    std::cout << "    " << std::left << std::setw(22) << label << std::right << std::fixed
+              << " " << std::setprecision(1) << std::setw(8) << c.search_ns
+              << " " << std::setprecision(0) << std::setw(7) << c.search_bytes
+              << " | " << std::setprecision(2) << std::setw(7) << c.scan_ns
+              << " " << std::setprecision(1) << std::setw(6) << c.scan_bytes
+              << " | " << std::setprecision(2) << std::setw(7) << c.update_ns
+              << " " << std::setprecision(1) << std::setw(6) << c.update_bytes
+              << " | " << std::setprecision(1) << std::setw(7) << c.sort_ns
+              << " " << std::setprecision(0) << std::setw(6) << c.sort_bytes << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout.precision(precision);
+}
+
+// ns and bytes touched per operation for each layout, at a cache-resident and
+// a DRAM-resident size. search: one random lookup; scan: sum the values of a
+// 10% key range in a full pass (per element); update: rewrite every value (per
+// element); sort: from random order (per element, bytes = working set).
+void benchmark_layouts(size_t max_elements = size_t(1) << 21) {
+    std::cout << "Data layouts (ns | bytes touched):\n";
+    for (size_t n : {size_t(1) << 12, max_elements}) {
+        std::vector<int> keys(n), values(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = static_cast<int>(i * 2);
+            values[i] = static_cast<int>(i);
+        }
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), std::mt19937(101));
+        std::vector<int> shuffled_keys(n), shuffled_values(n);
+        for (size_t i = 0; i < n; ++i) {
+            shuffled_keys[i] = keys[order[i]];
+            shuffled_values[i] = values[order[i]];
+        }
+        std::vector<int> probes = generate_random_ints(1000000, 0, static_cast<int>(n - 1), 102);
+        for (int& p : probes) p = keys[p];
+
+        std::cout << "  n = " << n << " (" << n * sizeof(PackedKeyValue) / 1024 << " KiB packed)\n";
+        std::cout << "    " << std::left << std::setw(22) << "layout" << std::right
+                  << " " << std::setw(8) << "search" << " " << std::setw(7) << "B/op"
+                  << " | " << std::setw(7) << "scan" << " " << std::setw(6) << "B/elem"
+                  << " | " << std::setw(7) << "update" << " " << std::setw(6) << "B/elem"
+                  << " | " << std::setw(7) << "sort" << " " << std::setw(6) << "B/elem" << "\n";
+        print_layout_costs("AoS packed (8 B)", measure_layout<AosLayout<PackedKeyValue>>(keys, values, shuffled_keys, shuffled_values, probes));
+        print_layout_costs("AoS KeyValue (64 B)", measure_layout<AosLayout<KeyValue>>(keys, values, shuffled_keys, shuffled_values, probes));
+        print_layout_costs("SoA", measure_layout<SoaLayout>(keys, values, shuffled_keys, shuffled_values, probes));
+        print_layout_costs("AoSoA (8 per line)", measure_layout<AosoaLayout>(keys, values, shuffled_keys, shuffled_values, probes));
+    }
+}
+
+#endif //LAYOUT_H
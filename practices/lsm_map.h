@@ -0,0 +1,222 @@
+#ifndef LSM_MAP_H
+#define LSM_MAP_H
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "map.h"
+
+// 写优化: CacheFriendlyMap::insert 每次都要 memmove 半个数组 --> O(n)。
+// Log-structured merge 的思路：写先进一个小的 buffer，满了之后排序成一个不可变的
+// run，run 之间按大小合并 (size-tiered)，最大的一层就是 CacheFriendlyMap 本身。
+//
+//   insert --> [delta buffer, unsorted, kBufferCapacity]
+//                   | full: sort
+//                   v
+//              [run k] [run k-1] ... [run 1]   newest .. oldest, sizes grow ~2x
+//                   | a run reaches main.size() / kMainMergeRatio
+//                   v
+//              [CacheFriendlyMap main]
+//
+// Every element is merged O(log(n / B)) times, so insert is amortized O(log n)
+// instead of O(n). get() checks the buffer first, then the runs newest to
+// oldest, then main; with the geometric sizes almost all keys live in main, so
+// reads are still binary searches over contiguous arrays. compact() folds
+// everything into main before a read-heavy phase. Merges run synchronously
+// when a threshold is crossed, which keeps the map single-threaded.
+class LsmCacheFriendlyMap {
+public:
+    static constexpr size_t kBufferCapacity = 64;
+    static constexpr size_t kMainMergeRatio = 4;
+
+    explicit LsmCacheFriendlyMap(size_t expected_size = 0) : main_(expected_size) {
+        buffer_keys_.reserve(kBufferCapacity);
+        buffer_values_.reserve(kBufferCapacity);
+    }
+
+    void bulk_insert(const std::vector<int>& keys, const std::vector<int>& values) {
+        compact();
+        main_.bulk_insert(keys, values);
+    }
+
+    void insert(int key, int value) {
+        // The buffer is small and contiguous: a linear scan the compiler vectorizes.
+        for (size_t i = 0; i < buffer_keys_.size(); ++i) {
+            if (buffer_keys_[i] == key) {
+                buffer_values_[i] = value;
+                return;
+            }
+        }
+        buffer_keys_.push_back(key);
+        buffer_values_.push_back(value);
+        if (buffer_keys_.size() == kBufferCapacity) {
+            flush_buffer();
+        }
+    }
+
+    int get(int key) const {
+        if (auto value = find(key)) {
+            return *value;
+        }
+        throw std::runtime_error("Key not found");
+    }
+
+    std::optional<int> find(int key) const {
+        for (size_t i = buffer_keys_.size(); i-- > 0;) {
+            if (buffer_keys_[i] == key) {
+                return buffer_values_[i];
+            }
+        }
+        for (auto run = runs_.rbegin(); run != runs_.rend(); ++run) {
+            auto it = std::lower_bound(run->keys.begin(), run->keys.end(), key);
+            if (it != run->keys.end() && *it == key) {
+                return run->values[it - run->keys.begin()];
+            }
+        }
+        return main_.find(key);
+    }
+
+    // Range scan over [lo, hi] in key order, newest version of each key.
+    template <typename F>
+    size_t scan(int lo, int hi, F&& callback) const {
+        // (key, age, value); age 0 is the newest source.
+        std::vector<std::tuple<int, size_t, int>> hits;
+        for (size_t i = 0; i < buffer_keys_.size(); ++i) {
+            if (buffer_keys_[i] >= lo && buffer_keys_[i] <= hi) {
+                hits.emplace_back(buffer_keys_[i], 0, buffer_values_[i]);
+            }
+        }
+        size_t age = 1;
+        for (auto run = runs_.rbegin(); run != runs_.rend(); ++run, ++age) {
+            auto first = std::lower_bound(run->keys.begin(), run->keys.end(), lo);
+            for (auto it = first; it != run->keys.end() && *it <= hi; ++it) {
+                hits.emplace_back(*it, age, run->values[it - run->keys.begin()]);
+            }
+        }
+        if (hits.empty()) {
+            return main_.scan(lo, hi, callback);
+        }
+        main_.scan(lo, hi, [&hits, age](int k, int v) { hits.emplace_back(k, age, v); });
+        std::sort(hits.begin(), hits.end());
+        size_t count = 0;
+        for (size_t i = 0; i < hits.size(); ++i) {
+            if (i > 0 && std::get<0>(hits[i]) == std::get<0>(hits[i - 1])) {
+                continue;
+            }
+            callback(std::get<0>(hits[i]), std::get<2>(hits[i]));
+            ++count;
+        }
+        return count;
+    }
+
+    // Fold the buffer and all runs into main.
+    void compact() {
+        flush_buffer();
+        while (!runs_.empty()) {
+            merge_oldest_run_into_main();
+        }
+    }
+
+    size_t run_count() const { return runs_.size(); }
+    const CacheFriendlyMap<>& main() const { return main_; }
+
+private:
+    struct Run {
+        std::vector<int> keys;
+        std::vector<int> values;
+    };
+
+    void flush_buffer() {
+        if (buffer_keys_.empty()) {
+            return;
+        }
+        std::vector<size_t> order(buffer_keys_.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(),
+                  [this](size_t lhs, size_t rhs) { return buffer_keys_[lhs] < buffer_keys_[rhs]; });
+        Run run;
+        run.keys.reserve(order.size());
+        run.values.reserve(order.size());
+        for (size_t i : order) {
+            run.keys.push_back(buffer_keys_[i]);
+            run.values.push_back(buffer_values_[i]);
+        }
+        buffer_keys_.clear();
+        buffer_values_.clear();
+        runs_.push_back(std::move(run));
+
+        // Size-tiered: merge the newest run into the previous one while it has
+        // caught up to half its size.
+        while (runs_.size() >= 2 && runs_.back().keys.size() * 2 >= runs_[runs_.size() - 2].keys.size()) {
+            Run newer = std::move(runs_.back());
+            runs_.pop_back();
+            Run& older = runs_.back();
+            Run merged;
+            merge_sorted_runs(older.keys, older.values, newer.keys, newer.values, merged.keys, merged.values);
+            older = std::move(merged);
+        }
+        if (!runs_.empty() && runs_.front().keys.size() * kMainMergeRatio >= main_.size()) {
+            // The oldest run is all that may be merged into main without
+            // letting an older value overwrite a newer one in a later run.
+            merge_oldest_run_into_main();
+        }
+    }
+
+    void merge_oldest_run_into_main() {
+        main_.merge_sorted(runs_.front().keys, runs_.front().values);
+        runs_.erase(runs_.begin());
+    }
+
+    CacheFriendlyMap<> main_;
+    std::vector<Run> runs_;  // oldest first
+    std::vector<int> buffer_keys_;
+    std::vector<int> buffer_values_;
+};
+
+// Random single-key ingest: CacheFriendlyMap::insert (O(n) memmove) vs the
+// buffered map vs std::map, then point reads before and after compaction.
+void benchmark_lsm_ingest(size_t num_keys = 100000) {
+    std::vector<int> keys = generate_random_ints(num_keys, 0, INT_MAX, 11);
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20, 12);
+
+    auto time_inserts = [&](auto& map) {
+        Stopwatch sw;
+        sw.start();
+        for (size_t i = 0; i < num_keys; ++i) map.insert(keys[i], values[i]);
+        return sw.stop().ns / num_keys;
+    };
+    auto time_gets = [&](const auto& map) {
+        volatile long checksum = 0;
+        Stopwatch sw;
+        sw.start();
+        for (size_t i = 0; i < num_keys; ++i) checksum += map.get(keys[i]);
+        return sw.stop().ns / num_keys;
+    };
+
+    std::cout << "Random ingest of " << num_keys << " keys (ns per insert / ns per get):\n";
+    {
+        OptimizedMap<> map;
+        double insert_ns = time_inserts(map);
+        std::cout << "  OptimizedMap (std::map): " << insert_ns << " / " << time_gets(map) << "\n";
+    }
+    {
+        CacheFriendlyMap<> map(num_keys);
+        double insert_ns = time_inserts(map);
+        std::cout << "  CacheFriendlyMap::insert: " << insert_ns << " / " << time_gets(map) << "\n";
+    }
+    {
+        LsmCacheFriendlyMap map(num_keys);
+        double insert_ns = time_inserts(map);
+        size_t runs = map.run_count();
+        double get_ns = time_gets(map);
+        map.compact();
+        std::cout << "  LsmCacheFriendlyMap: " << insert_ns << " / " << get_ns << " (" << runs << " runs)"
+                  << ", after compact: " << time_gets(map) << "\n";
+    }
+}
+
+#endif //LSM_MAP_H
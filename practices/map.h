@@ -2,11 +2,26 @@
 #define PRACTICE_H
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <emmintrin.h>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <queue>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "latency.h"
+#include "workload.h"
+
 // 高性能服务 (---)   [客户端] ----- [服务端]
 // c++ 性能优化这个问题，是很主观的
 // 1. 一个场景下适用的优化在另外一个场景下不好.
@@ -56,13 +71,45 @@
 // 2. 时间
 // 3.
 
+// Fixed-width string key, zero padded and ordered like memcmp. It is trivially
+// copyable, so it sits in a sorted key array just like an integer does.
+template <size_t N>
+struct FixedString {
+    char data[N] = {};
+
+    FixedString() = default;
+    explicit FixedString(const std::string& s) { std::memcpy(data, s.data(), std::min(N, s.size())); }
+
+    bool operator<(const FixedString& other) const { return std::memcmp(data, other.data, N) < 0; }
+    bool operator==(const FixedString& other) const { return std::memcmp(data, other.data, N) == 0; }
+
+    // First 8 bytes as a big-endian integer: prefixes compare as integers in
+    // the same order as memcmp on the whole key.
+    uint64_t prefix() const {
+        unsigned char bytes[8] = {0};
+        std::memcpy(bytes, data, std::min<size_t>(N, 8));
+        uint64_t prefix;
+        std::memcpy(&prefix, bytes, sizeof(prefix));
+        return __builtin_bswap64(prefix);
+    }
+};
+
+template <typename K, typename Compare>
+inline bool equivalent_keys(const Compare& comp, const K& a, const K& b) {
+    return !comp(a, b) && !comp(b, a);
+}
+
+// Instrumented = true records the latency of every get/find/try_get and insert
+// into per-thread histograms (latency.h); false compiles the timers out.
+template <typename K = int, typename V = int, typename Compare = std::less<K>, bool Instrumented = false>
 class NaiveMap {
 public:
-    void insert(int key, int value) {
+    void insert(const K& key, const V& value) {
+        ScopedLatency timer(insert_latency_);
         /// O(n)
         // Check if key exists and update value
         for (auto& pair : data_) {
-            if (pair.first == key) {
+            if (equivalent_keys(comp_, pair.first, key)) {
                 pair.second = value;
                 return;
             }
@@ -71,42 +118,142 @@ public:
         data_.emplace_back(key, value);
     }
 
-    int get(int key) const {
-        // O(n)
-        // Linear search for the key
+    const V& get(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key)) {
+            return *value;
+        }
+        throw std::runtime_error("Key not found");
+    }
+
+    // Non-throwing lookup: a miss costs the search, not an exception unwind.
+    std::optional<V> find(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key)) {
+            return *value;
+        }
+        return std::nullopt;
+    }
+
+    bool try_get(const K& key, V& value) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* found = lookup(key)) {
+            value = *found;
+            return true;
+        }
+        return false;
+    }
+
+    // Range scan over [lo, hi] in key order. Unsorted storage --> O(n + k log k).
+    template <typename F>
+    size_t scan(const K& lo, const K& hi, F&& callback) const {
+        std::vector<std::pair<K, V>> hits;
         for (const auto& pair : data_) {
-            if (pair.first == key) {
-                return pair.second;
+            if (!comp_(pair.first, lo) && !comp_(hi, pair.first)) {
+                hits.push_back(pair);
             }
         }
-        throw std::runtime_error("Key not found");
+        std::sort(hits.begin(), hits.end(),
+                  [this](const auto& lhs, const auto& rhs) { return comp_(lhs.first, rhs.first); });
+        for (const auto& pair : hits) {
+            callback(pair.first, pair.second);
+        }
+        return hits.size();
     }
 
+    // Instrumented maps only. The recorders are mutable: const lookups record too.
+    LatencyRecorder& lookup_latency() const { return lookup_latency_; }
+    LatencyRecorder& insert_latency() const { return insert_latency_; }
+
 private:
-    std::vector<std::pair<int, int>> data_;
+    // The one search behind get / find / try_get. O(n): linear search.
+    const V* lookup(const K& key) const {
+        for (const auto& pair : data_) {
+            if (equivalent_keys(comp_, pair.first, key)) {
+                return &pair.second;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<std::pair<K, V>> data_;
+    Compare comp_;
+    mutable LatencyRecorderFor<Instrumented> lookup_latency_;  // get, find, try_get
+    mutable LatencyRecorderFor<Instrumented> insert_latency_;
 };
 
 // 1. 算法变得更好 --> 降低时间复杂度。
 // O(n)  ---> O(logn)
 
+template <typename K = int, typename V = int, typename Compare = std::less<K>, bool Instrumented = false>
 class OptimizedMap {
 public:
-    void insert(int key, int value) {
+    using const_iterator = typename std::map<K, V, Compare>::const_iterator;
+
+    void insert(const K& key, const V& value) {
+        ScopedLatency timer(insert_latency_);
         data_[key] = value; // O(1) average time
     }
 
-    int get(int key) const {
-        auto it = data_.find(key); // O(1) average time
-        if (it != data_.end()) {
-            return it->second;
+    const V& get(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key)) {
+            return *value;
         }
         throw std::runtime_error("Key not found");
     }
 
+    std::optional<V> find(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key)) {
+            return *value;
+        }
+        return std::nullopt;
+    }
+
+    bool try_get(const K& key, V& value) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* found = lookup(key)) {
+            value = *found;
+            return true;
+        }
+        return false;
+    }
+
+    // Range scan over [lo, hi] in key order: one O(log n) descent, then a
+    // pointer chase per node.
+    template <typename F>
+    size_t scan(const K& lo, const K& hi, F&& callback) const {
+        size_t count = 0;
+        for (auto it = data_.lower_bound(lo); it != data_.end() && !data_.key_comp()(hi, it->first); ++it, ++count) {
+            callback(it->first, it->second);
+        }
+        return count;
+    }
+
+    // Iterator range over [lo, hi].
+    std::pair<const_iterator, const_iterator> range(const K& lo, const K& hi) const {
+        if (data_.key_comp()(hi, lo)) {
+            return {data_.end(), data_.end()};
+        }
+        return {data_.lower_bound(lo), data_.upper_bound(hi)};
+    }
+
+    // Instrumented maps only. The recorders are mutable: const lookups record too.
+    LatencyRecorder& lookup_latency() const { return lookup_latency_; }
+    LatencyRecorder& insert_latency() const { return insert_latency_; }
+
 private:
-    map<int, int> data_;
-};
+    // The one search behind get / find / try_get. O(log n): tree descent.
+    const V* lookup(const K& key) const {
+        auto it = data_.find(key);
+        return it != data_.end() ? &it->second : nullptr;
+    }
 
+    std::map<K, V, Compare> data_;
+    mutable LatencyRecorderFor<Instrumented> lookup_latency_;  // get, find, try_get
+    mutable LatencyRecorderFor<Instrumented> insert_latency_;
+};
 
 // 2. 第二重要：非阻塞。
 // 3. 第三重要：硬件，代码细节。
@@ -120,8 +267,189 @@ struct alignas(64) KeyValue {
 };
 
 
+// murmur3 fmix64
+inline uint64_t fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Filter hash: integers go straight through fmix64, other keys through std::hash.
+template <typename K>
+inline uint64_t bloom_hash(const K& key) {
+    if constexpr (std::is_integral<K>::value) {
+        return fmix64(static_cast<std::make_unsigned_t<K>>(key));
+    } else {
+        return fmix64(std::hash<K>{}(key));
+    }
+}
+
+template <size_t N>
+inline uint64_t bloom_hash(const FixedString<N>& key) {
+    uint64_t h = 0xcbf29ce484222325ull;  // FNV-1a
+    for (size_t i = 0; i < N; ++i) {
+        h = (h ^ static_cast<unsigned char>(key.data[i])) * 0x100000001b3ull;
+    }
+    return fmix64(h);
+}
+
+// Blocked Bloom filter ("split block" layout): each key maps to one 32-byte
+// block of 8 x 32-bit words and sets one bit per word. A probe reads a single
+// cache line and the 8 word tests are independent, so the compiler turns them
+// into vector ops. ~10 bits/key gives ~1% false positives.
+class BlockedBloomFilter {
+public:
+    BlockedBloomFilter() = default;
+
+    explicit BlockedBloomFilter(size_t expected_keys, double bits_per_key = 10.0)
+        : blocks_(std::max<size_t>(1, static_cast<size_t>(expected_keys * bits_per_key / 256) + 1)) {}
+
+    bool empty() const { return blocks_.empty(); }
+
+    template <typename K>
+    void add(const K& key) {
+        uint64_t h = bloom_hash(key);
+        Block& block = blocks_[block_index(h)];
+        for (int i = 0; i < 8; ++i) {
+            block.words[i] |= bit(h, i);
+        }
+    }
+
+    template <typename K>
+    __attribute__((always_inline)) bool may_contain(const K& key) const {
+        uint64_t h = bloom_hash(key);
+        const Block& block = blocks_[block_index(h)];
+        uint32_t missing = 0;
+        for (int i = 0; i < 8; ++i) {
+            missing |= ~block.words[i] & bit(h, i);
+        }
+        return missing == 0;
+    }
+
+    size_t bytes() const { return blocks_.size() * sizeof(Block); }
+
+private:
+    struct alignas(32) Block {
+        uint32_t words[8] = {0};
+    };
+
+    size_t block_index(uint64_t h) const {
+        return static_cast<size_t>(((h >> 32) * blocks_.size()) >> 32);  // multiply-shift instead of %
+    }
+
+    static uint32_t bit(uint64_t h, int i) {
+        static constexpr uint32_t kSalt[8] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+                                              0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+        return 1u << ((static_cast<uint32_t>(h) * kSalt[i]) >> 27);
+    }
+
+    std::vector<Block> blocks_;
+};
+
+// Linear merge of two sorted (key, value) runs into out; on equal keys the
+// newer run wins. Shared by CacheFriendlyMap::merge_sorted and the LSM levels.
+template <typename K, typename V, typename Compare = std::less<K>>
+inline void merge_sorted_runs(const std::vector<K>& old_keys, const std::vector<V>& old_values,
+                              const std::vector<K>& new_keys, const std::vector<V>& new_values,
+                              std::vector<K>& out_keys, std::vector<V>& out_values, Compare comp = Compare()) {
+    out_keys.clear();
+    out_values.clear();
+    out_keys.reserve(old_keys.size() + new_keys.size());
+    out_values.reserve(old_keys.size() + new_keys.size());
+    size_t i = 0, j = 0;
+    while (i < old_keys.size() && j < new_keys.size()) {
+        if (comp(old_keys[i], new_keys[j])) {
+            out_keys.push_back(old_keys[i]);
+            out_values.push_back(old_values[i++]);
+        } else {
+            if (!comp(new_keys[j], old_keys[i])) ++i;
+            out_keys.push_back(new_keys[j]);
+            out_values.push_back(new_values[j++]);
+        }
+    }
+    out_keys.insert(out_keys.end(), old_keys.begin() + i, old_keys.end());
+    out_values.insert(out_values.end(), old_values.begin() + i, old_values.end());
+    out_keys.insert(out_keys.end(), new_keys.begin() + j, new_keys.end());
+    out_values.insert(out_values.end(), new_values.begin() + j, new_values.end());
+}
+
+// Search kernels. CacheFriendlyMap picks one at compile time from the key type
+// and comparator; the key array itself is always contiguous.
+struct BinarySearchKernel {
+    static constexpr const char* name = "std::lower_bound";
+};
+struct IntegerSearchKernel {
+    static constexpr const char* name = "branchless + SIMD window";
+};
+struct PrefixSearchKernel {
+    static constexpr const char* name = "8-byte prefix + full key";
+};
+
+template <typename K, typename Compare>
+struct search_kernel {
+    using type = BinarySearchKernel;  // arbitrary comparator: only Compare is known to be valid
+};
+
+template <typename K>
+struct search_kernel<K, std::less<K>> {
+    using type = std::conditional_t<std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8),
+                                    IntegerSearchKernel, BinarySearchKernel>;
+};
+
+template <size_t N>
+struct search_kernel<FixedString<N>, std::less<FixedString<N>>> {
+    using type = PrefixSearchKernel;
+};
+
+// lower_bound for 32/64-bit integers: branchless halving (a cmov, no
+// mispredicts) down to a window of 16 keys, then count the window keys below
+// `key`. 32-bit keys are counted 4 at a time with SSE2; SSE2 has no 64-bit
+// compare, so 64-bit keys use a branch-free scalar count.
+template <typename T>
+__attribute__((always_inline)) inline size_t integer_lower_bound(const T* keys, size_t n, T key) {
+    constexpr size_t kWindow = 16;
+    size_t lo = 0, len = n;
+    while (len > kWindow) {
+        size_t half = len / 2;
+        // The cmov hides which half comes next from the branch predictor, so
+        // nothing loads it speculatively: prefetch both candidate midpoints.
+        __builtin_prefetch(keys + lo + half / 2);
+        __builtin_prefetch(keys + lo + half + half / 2);
+        lo = keys[lo + half - 1] < key ? lo + half : lo;
+        len -= half;
+    }
+    const T* window = keys + lo;
+    size_t less = 0, i = 0;
+    if constexpr (sizeof(T) == 4) {
+        // Unsigned keys compare signed after flipping the sign bit.
+        const __m128i flip = _mm_set1_epi32(std::is_signed<T>::value ? 0 : INT_MIN);
+        const __m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), flip);
+        for (; i + 4 <= len; i += 4) {
+            __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i)), flip);
+            less += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, needle))));
+        }
+    }
+    for (; i < len; ++i) {
+        less += window[i] < key;
+    }
+    return lo + less;
+}
+
+// Sorted parallel arrays: keys_ is searched, values_ is only touched on a hit.
+// Values of at most kInlineValueBytes are stored in values_ directly. Bigger
+// values live in an append-only slab and values_ holds 4-byte handles, so the
+// sort/insert paths move handles rather than payloads.
+template <typename K = int, typename V = int, typename Compare = std::less<K>, bool Instrumented = false>
 class CacheFriendlyMap {
 public:
+    using Kernel = typename search_kernel<K, Compare>::type;
+    static constexpr size_t kInlineValueBytes = 16;
+    static constexpr bool kInlineValues = sizeof(V) <= kInlineValueBytes;
+    using Slot = std::conditional_t<kInlineValues, V, uint32_t>;
+
     CacheFriendlyMap(size_t expected_size = 0) {
         if (expected_size > 0) {
             keys_.reserve(expected_size);
@@ -130,18 +458,8 @@ public:
     }
 
     // Batch insertions to optimize insertion time
-    void bulk_insert(const std::vector<int>& keys, const std::vector<int>& values) {
-        if (keys.size() != values.size()) {
-            throw std::invalid_argument("Keys and values must have the same size");
-        }
-
-        size_t total_size = keys_.size() + keys.size();
-        keys_.reserve(total_size);
-        values_.reserve(total_size);
-
-        // Append new keys and values
-        keys_.insert(keys_.end(), keys.begin(), keys.end());
-        values_.insert(values_.end(), values.begin(), values.end());
+    void bulk_insert(const std::vector<K>& keys, const std::vector<V>& values) {
+        append(keys, values);
 
         // Create index vector for sorting
         std::vector<size_t> indices(keys_.size());
@@ -151,11 +469,11 @@ public:
 
         // Sort indices based on keys
         std::sort(indices.begin(), indices.end(),
-                  [this](size_t lhs, size_t rhs) { return keys_[lhs] < keys_[rhs]; });
+                  [this](size_t lhs, size_t rhs) { return comp_(keys_[lhs], keys_[rhs]); });
 
         // Apply sorted order to keys and values
-        std::vector<int> sorted_keys(keys_.size());
-        std::vector<int> sorted_values(values_.size());
+        std::vector<K> sorted_keys(keys_.size());
+        std::vector<Slot> sorted_values(values_.size());
 
         for (size_t i = 0; i < indices.size(); ++i) {
             sorted_keys[i] = keys_[indices[i]];
@@ -164,40 +482,421 @@ public:
 
         keys_.swap(sorted_keys);
         values_.swap(sorted_values);
+        sync_prefixes();
+        rebuild_filter();
+    }
+
+    // Parallel version of bulk_insert: same result, built in three phases.
+    // 1. Each thread sorts its chunk of elements that carry the original index,
+    //    which makes every element unique and keeps equal keys in insertion
+    //    order. 32-bit integer keys are packed as (biased key << 32 | index) so
+    //    a compare is one 64-bit compare; other keys sort indices by (key, index).
+    // 2. Splitters sampled from the sorted chunks cut the output into one key
+    //    range per thread; lower_bound gives each chunk's slice of each range.
+    // 3. Each thread multiway-merges its slices and gathers keys/values straight
+    //    into its own region of the output.
+    void parallel_bulk_insert(const std::vector<K>& keys, const std::vector<V>& values,
+                              unsigned num_threads = std::thread::hardware_concurrency()) {
+        // Checked before append so that an oversized batch leaves the map unchanged.
+        if (keys_.size() + keys.size() > UINT32_MAX) {
+            throw std::length_error("parallel_bulk_insert packs indices in 32 bits");
+        }
+        append(keys, values);
+        if constexpr (std::is_integral<K>::value && sizeof(K) == 4 && std::is_same<Compare, std::less<K>>::value) {
+            parallel_sort_gather<uint64_t>(
+                num_threads,
+                [this](size_t i) {
+                    uint32_t biased = static_cast<uint32_t>(keys_[i]) ^ (std::is_signed<K>::value ? 0x80000000u : 0u);
+                    return (static_cast<uint64_t>(biased) << 32) | i;
+                },
+                std::less<uint64_t>(), [](uint64_t element) { return static_cast<uint32_t>(element); });
+        } else {
+            parallel_sort_gather<uint32_t>(
+                num_threads, [](size_t i) { return static_cast<uint32_t>(i); },
+                [this](uint32_t lhs, uint32_t rhs) {
+                    return comp_(keys_[lhs], keys_[rhs]) || (!comp_(keys_[rhs], keys_[lhs]) && lhs < rhs);
+                },
+                [](uint32_t element) { return element; });
+        }
+        sync_prefixes();
+        rebuild_filter();
     }
 
     // Single insertion (less efficient than bulk_insert)
-    __attribute__((always_inline)) void insert(int key, int value) {
-        auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
-        size_t index = it - keys_.begin();
-        if (__builtin_expect(it != keys_.end() && *it == key, 1)) {
-            values_[index] = value; // Update existing key
+    __attribute__((always_inline)) void insert(const K& key, const V& value) {
+        ScopedLatency timer(insert_latency_);
+        size_t index = lower_bound_index(key);
+        if (__builtin_expect(index < keys_.size() && !comp_(key, keys_[index]), 1)) {
+            assign_value(index, value); // Update existing key
         } else {
-            keys_.insert(it, key);
-            values_.insert(values_.begin() + index, value);
+            keys_.insert(keys_.begin() + index, key);
+            values_.insert(values_.begin() + index, make_slot(value));
+            if constexpr (std::is_same<Kernel, PrefixSearchKernel>::value) {
+                prefixes_.insert(prefixes_.begin() + index, key.prefix());
+            }
+            if (!filter_.empty()) filter_.add(key);
         }
     }
 
-     __attribute__((always_inline)) int get(int key) const {
-        auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
-        size_t index = it - keys_.begin();
-        if (__builtin_expect(it != keys_.end() && *it == key, 1)) {
-            return values_[index]; // Key found
+    // Put a Bloom filter in front of the binary search, for miss-heavy
+    // lookups. It is rebuilt by the bulk paths; single inserts add to it, so
+    // the false-positive rate rises if the map grows far past this size.
+    void enable_filter(double bits_per_key = 10.0) {
+        filter_bits_per_key_ = bits_per_key;
+        rebuild_filter();
+    }
+
+    size_t filter_bytes() const { return filter_.bytes(); }
+
+    // Merge an already sorted, duplicate-free run in O(n + m); its values
+    // replace existing ones. This is how write buffers are folded in.
+    void merge_sorted(const std::vector<K>& keys, const std::vector<V>& values) {
+        if (keys.size() != values.size()) {
+            throw std::invalid_argument("Keys and values must have the same size");
+        }
+        std::vector<Slot> slots;
+        if constexpr (kInlineValues) {
+            slots = values;
+        } else {
+            slots.reserve(values.size());
+            for (const V& value : values) slots.push_back(make_slot(value));
+        }
+        std::vector<K> merged_keys;
+        std::vector<Slot> merged_values;
+        merge_sorted_runs(keys_, values_, keys, slots, merged_keys, merged_values, comp_);
+        keys_.swap(merged_keys);
+        values_.swap(merged_values);
+        if constexpr (!kInlineValues) {
+            // Replaced slab entries are garbage; rewrite the slab in key order
+            // once they outnumber the live ones.
+            if (slab_.size() > 2 * keys_.size()) compact_slab();
+        }
+        sync_prefixes();
+        rebuild_filter();
+    }
+
+    __attribute__((always_inline)) const V& get(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key); __builtin_expect(value != nullptr, 1)) {
+            return *value;
         }
         throw std::runtime_error("Key not found");
     }
 
+    // Non-throwing lookup. With the filter enabled most misses return after
+    // one cache line instead of a full binary search.
+    __attribute__((always_inline)) std::optional<V> find(const K& key) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* value = lookup(key)) {
+            return *value;
+        }
+        return std::nullopt;
+    }
+
+    __attribute__((always_inline)) bool try_get(const K& key, V& value) const {
+        ScopedLatency timer(lookup_latency_);
+        if (const V* found = lookup(key)) {
+            value = *found;
+            return true;
+        }
+        return false;
+    }
+
+    // Random-access iterator over the parallel keys_/values_ arrays, yields
+    // (key, value) by value (there is no pair to point at), like vector<bool>'s proxy.
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::pair<K, V>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        const_iterator() : map_(nullptr), index_(0) {}
+        const_iterator(const CacheFriendlyMap* map, size_t index) : map_(map), index_(index) {}
+        value_type operator*() const { return {map_->keys_[index_], map_->value_at(index_)}; }
+        value_type operator[](difference_type n) const { return *(*this + n); }
+
+        const_iterator& operator++() { ++index_; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; ++index_; return old; }
+        const_iterator& operator--() { --index_; return *this; }
+        const_iterator operator--(int) { const_iterator old = *this; --index_; return old; }
+        const_iterator& operator+=(difference_type n) { index_ += n; return *this; }
+        const_iterator& operator-=(difference_type n) { index_ -= n; return *this; }
+        const_iterator operator+(difference_type n) const { return {map_, index_ + n}; }
+        const_iterator operator-(difference_type n) const { return {map_, index_ - n}; }
+        friend const_iterator operator+(difference_type n, const const_iterator& it) { return it + n; }
+        difference_type operator-(const const_iterator& other) const {
+            return static_cast<difference_type>(index_) - static_cast<difference_type>(other.index_);
+        }
+
+        bool operator==(const const_iterator& other) const { return index_ == other.index_; }
+        bool operator!=(const const_iterator& other) const { return index_ != other.index_; }
+        bool operator<(const const_iterator& other) const { return index_ < other.index_; }
+        bool operator>(const const_iterator& other) const { return index_ > other.index_; }
+        bool operator<=(const const_iterator& other) const { return index_ <= other.index_; }
+        bool operator>=(const const_iterator& other) const { return index_ >= other.index_; }
+
+    private:
+        const CacheFriendlyMap* map_;
+        size_t index_;
+    };
+
+    const std::vector<K>& keys() const { return keys_; }
+    const std::vector<V>& values() const {
+        static_assert(kInlineValues, "values() needs inline value storage");
+        return values_;
+    }
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, keys_.size()}; }
+    size_t size() const { return keys_.size(); }
+
+    // Iterator range over [lo, hi].
+    std::pair<const_iterator, const_iterator> range(const K& lo, const K& hi) const {
+        auto bounds = range_indices(lo, hi);
+        return {const_iterator(this, bounds.first), const_iterator(this, bounds.second)};
+    }
+
+    // Range scan over [lo, hi]: the bounds are resolved once, then the loop
+    // walks two contiguous arrays with no per-element compare.
+    template <typename F>
+    size_t scan(const K& lo, const K& hi, F&& callback) const {
+        auto bounds = range_indices(lo, hi);
+        const K* keys = keys_.data();
+        for (size_t i = bounds.first; i < bounds.second; ++i) {
+            callback(keys[i], value_at(i));
+        }
+        return bounds.second - bounds.first;
+    }
+
+    // Instrumented maps only. The recorders are mutable: const lookups record too.
+    LatencyRecorder& lookup_latency() const { return lookup_latency_; }
+    LatencyRecorder& insert_latency() const { return insert_latency_; }
+
 private:
-    std::vector<int> keys_;
-    std::vector<int> values_;
+    // The one search behind get / find / try_get: the Bloom filter check, then
+    // the binary search.
+    __attribute__((always_inline)) const V* lookup(const K& key) const {
+        if (!filter_.empty() && !filter_.may_contain(key)) {
+            return nullptr;
+        }
+        size_t index = lower_bound_index(key);
+        if (index < keys_.size() && !comp_(key, keys_[index])) {
+            return &value_at(index);
+        }
+        return nullptr;
+    }
+
+    // Short ranges are the common case: instead of a second binary search
+    // for the end, compare the next kScanProbe keys against hi with SSE2
+    // (4 keys per compare, no data-dependent branches). Longer ranges fall
+    // back to upper_bound on the remainder.
+    static constexpr size_t kScanProbe = 64;
+
+    __attribute__((always_inline)) size_t lower_bound_index(const K& key) const {
+        if constexpr (std::is_same<Kernel, IntegerSearchKernel>::value) {
+            return integer_lower_bound(keys_.data(), keys_.size(), key);
+        } else if constexpr (std::is_same<Kernel, PrefixSearchKernel>::value) {
+            // Most keys differ in the first 8 bytes: search the dense prefix
+            // array, then compare full keys only among equal prefixes.
+            uint64_t prefix = key.prefix();
+            size_t first = integer_lower_bound(prefixes_.data(), prefixes_.size(), prefix);
+            size_t last = std::upper_bound(prefixes_.begin() + first, prefixes_.end(), prefix) - prefixes_.begin();
+            return std::lower_bound(keys_.begin() + first, keys_.begin() + last, key, comp_) - keys_.begin();
+        } else {
+            return std::lower_bound(keys_.begin(), keys_.end(), key, comp_) - keys_.begin();
+        }
+    }
+
+    std::pair<size_t, size_t> range_indices(const K& lo, const K& hi) const {
+        if (comp_(hi, lo)) {
+            return {0, 0};
+        }
+        size_t first = lower_bound_index(lo);
+        size_t limit = first;
+        if constexpr (std::is_same<Kernel, IntegerSearchKernel>::value && sizeof(K) == 4 && std::is_signed<K>::value) {
+            limit = std::min(keys_.size(), first + kScanProbe);
+            const __m128i bound = _mm_set1_epi32(hi);
+            size_t i = first;
+            for (; i + 4 <= limit; i += 4) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys_.data() + i));
+                int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, bound)));
+                if (mask != 0) {
+                    return {first, i + __builtin_ctz(mask)};
+                }
+            }
+            for (; i < limit; ++i) {
+                if (keys_[i] > hi) {
+                    return {first, i};
+                }
+            }
+            if (limit == keys_.size()) {
+                return {first, limit};
+            }
+        }
+        return {first, static_cast<size_t>(std::upper_bound(keys_.begin() + limit, keys_.end(), hi, comp_) - keys_.begin())};
+    }
+
+    void append(const std::vector<K>& keys, const std::vector<V>& values) {
+        if (keys.size() != values.size()) {
+            throw std::invalid_argument("Keys and values must have the same size");
+        }
+        keys_.reserve(keys_.size() + keys.size());
+        values_.reserve(values_.size() + values.size());
+        keys_.insert(keys_.end(), keys.begin(), keys.end());
+        if constexpr (kInlineValues) {
+            values_.insert(values_.end(), values.begin(), values.end());
+        } else {
+            slab_.reserve(slab_.size() + values.size());
+            for (const V& value : values) values_.push_back(make_slot(value));
+        }
+    }
+
+    template <typename E, typename Make, typename Less, typename IndexOf>
+    void parallel_sort_gather(unsigned num_threads, Make make, Less less, IndexOf index_of) {
+        const size_t n = keys_.size();
+        size_t threads = std::max<size_t>(1, std::min<size_t>(num_threads, n / 4096 + 1));
+
+        auto run_parallel = [threads](auto&& body) {
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; ++t) workers.emplace_back(body, t);
+            body(0);
+            for (auto& w : workers) w.join();
+        };
+        auto chunk_begin = [n, threads](size_t t) { return n * t / threads; };
+
+        // Phase 1: build and sort chunks.
+        std::vector<E> elements(n);
+        run_parallel([&](size_t t) {
+            for (size_t i = chunk_begin(t); i < chunk_begin(t + 1); ++i) {
+                elements[i] = make(i);
+            }
+            std::sort(elements.begin() + chunk_begin(t), elements.begin() + chunk_begin(t + 1), less);
+        });
+
+        // Phase 2: splitters and per-(range, chunk) slices.
+        constexpr size_t kOversample = 32;
+        std::vector<E> samples;
+        for (size_t t = 0; t < threads; ++t) {
+            size_t len = chunk_begin(t + 1) - chunk_begin(t);
+            for (size_t s = 1; s <= kOversample && len > 0; ++s) {
+                samples.push_back(elements[chunk_begin(t) + len * s / (kOversample + 1)]);
+            }
+        }
+        std::sort(samples.begin(), samples.end(), less);
+        std::vector<E> splitters;
+        for (size_t p = 1; p < threads; ++p) {
+            splitters.push_back(samples[samples.size() * p / threads]);
+        }
+        // cut[c][p] = first element of chunk c that belongs to range p.
+        std::vector<std::vector<size_t>> cut(threads, std::vector<size_t>(threads + 1));
+        for (size_t c = 0; c < threads; ++c) {
+            cut[c][0] = chunk_begin(c);
+            for (size_t p = 1; p < threads; ++p) {
+                cut[c][p] = std::lower_bound(elements.begin() + chunk_begin(c), elements.begin() + chunk_begin(c + 1),
+                                             splitters[p - 1], less) - elements.begin();
+            }
+            cut[c][threads] = chunk_begin(c + 1);
+        }
+        std::vector<size_t> out_begin(threads + 1, 0);
+        for (size_t p = 0; p < threads; ++p) {
+            out_begin[p + 1] = out_begin[p];
+            for (size_t c = 0; c < threads; ++c) out_begin[p + 1] += cut[c][p + 1] - cut[c][p];
+        }
+
+        // Phase 3: multiway merge + gather.
+        std::vector<K> sorted_keys(n);
+        std::vector<Slot> sorted_values(n);
+        run_parallel([&](size_t p) {
+            using Cursor = std::pair<E, size_t>;  // (head element, chunk)
+            auto later = [&less](const Cursor& lhs, const Cursor& rhs) { return less(rhs.first, lhs.first); };
+            std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+            std::vector<size_t> pos(threads);
+            for (size_t c = 0; c < threads; ++c) {
+                pos[c] = cut[c][p];
+                if (pos[c] < cut[c][p + 1]) heap.emplace(elements[pos[c]], c);
+            }
+            for (size_t out = out_begin[p]; !heap.empty(); ++out) {
+                auto [head, c] = heap.top();
+                heap.pop();
+                size_t index = index_of(head);
+                sorted_keys[out] = keys_[index];
+                sorted_values[out] = values_[index];
+                if (++pos[c] < cut[c][p + 1]) heap.emplace(elements[pos[c]], c);
+            }
+        });
+
+        keys_.swap(sorted_keys);
+        values_.swap(sorted_values);
+    }
+
+    Slot make_slot(const V& value) {
+        if constexpr (kInlineValues) {
+            return value;
+        } else {
+            slab_.push_back(value);
+            return static_cast<uint32_t>(slab_.size() - 1);
+        }
+    }
+
+    __attribute__((always_inline)) const V& value_at(size_t index) const {
+        if constexpr (kInlineValues) {
+            return values_[index];
+        } else {
+            return slab_[values_[index]];
+        }
+    }
+
+    void assign_value(size_t index, const V& value) {
+        if constexpr (kInlineValues) {
+            values_[index] = value;
+        } else {
+            slab_[values_[index]] = value;
+        }
+    }
+
+    void compact_slab() {
+        std::vector<V> slab;
+        slab.reserve(values_.size());
+        for (Slot& slot : values_) {
+            slab.push_back(slab_[slot]);
+            slot = static_cast<uint32_t>(slab.size() - 1);
+        }
+        slab_.swap(slab);
+    }
+
+    void sync_prefixes() {
+        if constexpr (std::is_same<Kernel, PrefixSearchKernel>::value) {
+            prefixes_.resize(keys_.size());
+            for (size_t i = 0; i < keys_.size(); ++i) prefixes_[i] = keys_[i].prefix();
+        }
+    }
+
+    void rebuild_filter() {
+        if (filter_bits_per_key_ <= 0) {
+            return;
+        }
+        filter_ = BlockedBloomFilter(keys_.size(), filter_bits_per_key_);
+        for (const K& key : keys_) filter_.add(key);
+    }
+
+    std::vector<K> keys_;
+    std::vector<Slot> values_;
+    std::vector<V> slab_;             // out-of-line values, indexed by values_
+    std::vector<uint64_t> prefixes_;  // PrefixSearchKernel only: keys_[i].prefix()
+    Compare comp_;
+    BlockedBloomFilter filter_;
+    double filter_bits_per_key_ = 0;  // 0: no filter
+    mutable LatencyRecorderFor<Instrumented> lookup_latency_;  // get, find, try_get
+    mutable LatencyRecorderFor<Instrumented> insert_latency_;
 };
 
-// Helper function to generate random integers
-std::vector<int> generate_random_ints(size_t count, int min, int max) {
+// Helper function to generate random integers (seeded, so runs are reproducible)
+std::vector<int> generate_random_ints(size_t count, int min, int max, uint32_t seed = 42) {
     std::vector<int> data(count);
-    std::random_device rd;
-    std::mt19937 mt(rd());
-    uniform_int_distribution<int> dist(min, max);
+    std::mt19937 mt(seed);
+    std::uniform_int_distribution<int> dist(min, max);
 
     for (size_t i = 0; i < count; ++i) {
         data[i] = dist(mt);
@@ -223,7 +922,7 @@ void benchmark_map() {
 
     // Benchmark Naive (Code 1)
     {
-        NaiveMap map;
+        NaiveMap<> map;
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -252,7 +951,7 @@ void benchmark_map() {
 
     // Benchmark OptimizedMap (Code 2)
     {
-        OptimizedMap map;
+        OptimizedMap<> map;
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -281,7 +980,7 @@ void benchmark_map() {
 
     // Benchmark CacheFriendlyMap (Code 3)
     {
-        CacheFriendlyMap map(NUM_OPERATIONS+2);
+        CacheFriendlyMap<> map(NUM_OPERATIONS+2);
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -311,12 +1010,12 @@ void benchmark_map_random() {
     const size_t NUM_OPERATIONS = 10000;
 
     // Generate random keys and values
-    std::vector<int> keys = generate_random_ints(NUM_OPERATIONS, 1, NUM_OPERATIONS * 10);
-    std::vector<int> values = generate_random_ints(NUM_OPERATIONS, 1, NUM_OPERATIONS * 10);
+    std::vector<int> keys = generate_random_ints(NUM_OPERATIONS, 1, NUM_OPERATIONS * 10, 1);
+    std::vector<int> values = generate_random_ints(NUM_OPERATIONS, 1, NUM_OPERATIONS * 10, 2);
 
     // Benchmark Naive (Code 1)
     {
-        NaiveMap map;
+        NaiveMap<> map;
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -345,7 +1044,7 @@ void benchmark_map_random() {
 
     // Benchmark OptimizedMap (Code 2)
     {
-        OptimizedMap map;
+        OptimizedMap<> map;
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -374,7 +1073,7 @@ void benchmark_map_random() {
 
     // Benchmark CacheFriendlyMap (Code 3)
     {
-        CacheFriendlyMap map(NUM_OPERATIONS+2);
+        CacheFriendlyMap<> map(NUM_OPERATIONS+2);
 
         // Measure insertion time
         auto start_insert = std::chrono::high_resolution_clock::now();
@@ -397,4 +1096,371 @@ void benchmark_map_random() {
     }
 }
 
+// Replays a generated operation mix.
+template <typename Map>
+double run_workload(Map& map, const std::vector<Operation>& ops) {
+    volatile long checksum = 0;
+    long scanned = 0;
+    Stopwatch sw;
+    sw.start();
+    for (const auto& op : ops) {
+        switch (op.type) {
+            case OpType::Scan:
+                map.scan(op.key, op.scan_hi, [&scanned](int, int value) { scanned += value; });
+                break;
+            case OpType::Read:
+                if (auto value = map.find(op.key)) {
+                    checksum += *value;
+                }
+                break;
+            case OpType::Update:
+            case OpType::Insert:
+                map.insert(op.key, op.value);
+                break;
+        }
+    }
+    Timing t = sw.stop();
+    checksum += scanned;
+    return t.ns * 1e-9;
+}
+
+template <typename Map>
+void report_workload(const char* label, Map& map, const std::vector<Operation>& ops) {
+    double seconds = run_workload(map, ops);
+    std::cout << label << ": " << seconds << " seconds, "
+              << ops.size() / seconds / 1e6 << " Mops/s\n";
+}
+
+void benchmark_map_workload(const WorkloadSpec& spec) {
+    WorkloadGenerator generator(spec);
+    std::vector<int> keys = generator.load_keys();
+    std::vector<int> values = generate_random_ints(keys.size(), 1, 1 << 30, static_cast<uint32_t>(spec.seed));
+    std::vector<Operation> ops = generator.operations();
+
+    std::cout << "Workload " << spec.name << ": " << spec.record_count << " records, "
+              << ops.size() << " operations\n";
+    {
+        NaiveMap<> map;
+        for (size_t i = 0; i < keys.size(); ++i) map.insert(keys[i], values[i]);
+        report_workload("  NaiveMap", map, ops);
+    }
+    {
+        OptimizedMap<> map;
+        for (size_t i = 0; i < keys.size(); ++i) map.insert(keys[i], values[i]);
+        report_workload("  OptimizedMap", map, ops);
+    }
+    {
+        CacheFriendlyMap<> map(keys.size() + ops.size());
+        map.bulk_insert(keys, values);
+        report_workload("  CacheFriendlyMap", map, ops);
+    }
+    std::cout << "\n";
+}
+
+void benchmark_map_ycsb() {
+    for (char which : {'A', 'B', 'C', 'D', 'E'}) {
+        benchmark_map_workload(ycsb_workload(which));
+    }
+    WorkloadSpec hotspot;
+    hotspot.name = "hotspot 80/20 reads";
+    hotspot.distribution = KeyDistribution::Hotspot;
+    benchmark_map_workload(hotspot);
+}
+
+// Range scans at increasing selectivity (fraction of the key space covered).
+// std::map pays a dependent load per node; CacheFriendlyMap streams two arrays.
+template <typename Map>
+double time_scans(const Map& map, const std::vector<int>& starts, int64_t span, long& returned) {
+    volatile long checksum = 0;
+    long sum = 0;
+    returned = 0;
+    Stopwatch sw;
+    sw.start();
+    for (int lo : starts) {
+        int hi = static_cast<int>(std::min<int64_t>(INT_MAX, lo + span));
+        returned += map.scan(lo, hi, [&sum](int, int value) { sum += value; });
+    }
+    Timing t = sw.stop();
+    checksum += sum;
+    return t.ns;
+}
+
+void benchmark_map_range_scan(size_t num_keys = 1000000) {
+    WorkloadSpec spec;
+    spec.record_count = num_keys;
+    std::vector<int> keys = WorkloadGenerator(spec).load_keys();
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20);
+
+    OptimizedMap<> tree;
+    for (size_t i = 0; i < num_keys; ++i) tree.insert(keys[i], values[i]);
+    CacheFriendlyMap<> array(num_keys);
+    array.bulk_insert(keys, values);
+
+    std::cout << "Range scan over " << num_keys << " keys (ns per scan / ns per returned key):\n";
+    for (double selectivity : {0.00001, 0.0001, 0.001, 0.01, 0.1, 1.0}) {
+        auto span = static_cast<int64_t>(selectivity * INT_MAX);
+        size_t scans = std::max<size_t>(1, static_cast<size_t>(2000 / (selectivity * 1000 + 1)));
+        std::vector<int> starts = generate_random_ints(scans, 0, static_cast<int>(INT_MAX - span), 7);
+
+        long tree_rows = 0, array_rows = 0;
+        double tree_ns = time_scans(tree, starts, span, tree_rows);
+        double array_ns = time_scans(array, starts, span, array_rows);
+        std::cout << "  selectivity " << selectivity * 100 << "%: "
+                  << "std::map " << tree_ns / scans << " / " << tree_ns / std::max(1L, tree_rows)
+                  << ", CacheFriendlyMap " << array_ns / scans << " / " << array_ns / std::max(1L, array_rows) << "\n";
+    }
+}
+
+// Serial bulk_insert vs parallel_bulk_insert at 1..all hardware threads.
+void benchmark_parallel_bulk_insert(size_t num_keys = 100000000) {
+    std::vector<int> keys = generate_random_ints(num_keys, INT_MIN, INT_MAX, 41);
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20, 42);
+    auto seconds = [](auto&& build) {
+        Stopwatch sw;
+        sw.start();
+        build();
+        return sw.stop().ns * 1e-9;
+    };
+
+    std::cout << "Bulk insert of " << num_keys << " keys:\n";
+    double serial = seconds([&] {
+        CacheFriendlyMap<> map;
+        map.bulk_insert(keys, values);
+    });
+    std::cout << "  bulk_insert (serial): " << serial << " seconds\n";
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double one_thread = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+        double t = seconds([&] {
+            CacheFriendlyMap<> map;
+            map.parallel_bulk_insert(keys, values, threads);
+        });
+        if (threads == 1) one_thread = t;
+        std::cout << "  parallel_bulk_insert, " << threads << " threads: " << t << " seconds, speedup "
+                  << one_thread / t << "x, efficiency " << one_thread / t / threads * 100 << "%\n";
+    }
+}
+
+// Lookup cost as the fraction of missing keys goes from 0% to 100%:
+// get() + catch vs find() vs find() behind the Bloom filter.
+void benchmark_map_miss_ratio(size_t num_keys = 1000000, size_t num_probes = 200000) {
+    WorkloadSpec spec;
+    spec.record_count = num_keys * 2;  // ordinals >= num_keys are never loaded
+    std::vector<int> all_keys = WorkloadGenerator(spec).load_keys();
+    std::vector<int> keys(all_keys.begin(), all_keys.begin() + num_keys);
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20, 51);
+
+    OptimizedMap<> tree;
+    for (size_t i = 0; i < num_keys; ++i) tree.insert(keys[i], values[i]);
+    CacheFriendlyMap<> array(num_keys);
+    array.bulk_insert(keys, values);
+    CacheFriendlyMap<> filtered(num_keys);
+    filtered.bulk_insert(keys, values);
+    filtered.enable_filter();
+
+    auto per_probe_ns = [num_probes](auto&& lookup, const std::vector<int>& probes) {
+        volatile long checksum = 0;
+        long sum = 0;
+        Stopwatch sw;
+        sw.start();
+        for (int key : probes) sum += lookup(key);
+        Timing t = sw.stop();
+        checksum += sum;
+        return t.ns / num_probes;
+    };
+    auto with_catch = [](const auto& map) {
+        return [&map](int key) {
+            try {
+                return map.get(key);
+            } catch (const std::runtime_error&) {
+                return 0;
+            }
+        };
+    };
+    auto with_find = [](const auto& map) {
+        return [&map](int key) { return map.find(key).value_or(0); };
+    };
+
+    std::cout << "Lookup vs miss ratio, " << num_keys << " keys, filter "
+              << filtered.filter_bytes() / 1024 << " KiB (ns per lookup):\n";
+    std::mt19937 rng(52);
+    for (int miss_percent = 0; miss_percent <= 100; miss_percent += 20) {
+        std::vector<int> probes(num_probes);
+        for (auto& probe : probes) {
+            size_t ordinal = rng() % num_keys;
+            probe = static_cast<int>(rng() % 100) < miss_percent ? all_keys[num_keys + ordinal] : keys[ordinal];
+        }
+        std::cout << "  miss " << miss_percent << "%: "
+                  << "std::map get+catch " << per_probe_ns(with_catch(tree), probes)
+                  << ", std::map find " << per_probe_ns(with_find(tree), probes)
+                  << " | array get+catch " << per_probe_ns(with_catch(array), probes)
+                  << ", array find " << per_probe_ns(with_find(array), probes)
+                  << ", array find+bloom " << per_probe_ns(with_find(filtered), probes) << "\n";
+    }
+}
+
+// One lookup benchmark per key/value instantiation: which search kernel and
+// value storage each combination compiles to, against std::map with the same types.
+struct Payload64 {
+    int64_t fields[8];
+};
+
+template <typename V>
+V make_value(size_t i) {
+    if constexpr (std::is_arithmetic<V>::value) {
+        return static_cast<V>(i);
+    } else {
+        V value{};
+        value.fields[0] = static_cast<int64_t>(i);
+        return value;
+    }
+}
+
+template <typename V>
+long value_checksum(const V& value) {
+    if constexpr (std::is_arithmetic<V>::value) {
+        return static_cast<long>(value);
+    } else {
+        return static_cast<long>(value.fields[0]);
+    }
+}
+
+template <typename K, typename V, typename Compare = std::less<K>, typename MakeKey>
+void benchmark_map_type(const char* label, size_t num_keys, MakeKey make_key) {
+    using Array = CacheFriendlyMap<K, V, Compare>;
+    std::vector<K> keys(num_keys);
+    std::vector<V> values(num_keys);
+    for (size_t i = 0; i < num_keys; ++i) {
+        keys[i] = make_key(i);
+        values[i] = make_value<V>(i);
+    }
+    OptimizedMap<K, V, Compare> tree;
+    for (size_t i = 0; i < num_keys; ++i) tree.insert(keys[i], values[i]);
+    Array array(num_keys);
+    array.bulk_insert(keys, values);
+
+    std::vector<K> probes = keys;
+    std::shuffle(probes.begin(), probes.end(), std::mt19937(61));
+    probes.resize(std::min<size_t>(probes.size(), 1000000));
+    auto per_get_ns = [&probes](const auto& map) {
+        volatile long checksum = 0;
+        long sum = 0;
+        Stopwatch sw;
+        sw.start();
+        for (const K& key : probes) sum += value_checksum(map.get(key));
+        Timing t = sw.stop();
+        checksum += sum;
+        return t.ns / probes.size();
+    };
+
+    std::cout << "  " << label << " [" << Array::Kernel::name << ", "
+              << (Array::kInlineValues ? "inline values" : "slab values") << "]: std::map "
+              << per_get_ns(tree) << " ns/get, CacheFriendlyMap " << per_get_ns(array) << " ns/get\n";
+}
+
+void benchmark_map_types(size_t num_keys = 1000000) {
+    auto hashed = [](size_t i) { return (i * 0x9e3779b97f4a7c15ull) >> 1; };
+    std::cout << "Map instantiations, " << num_keys << " keys:\n";
+    benchmark_map_type<int, int>("int -> int", num_keys,
+                                 [](size_t i) { return static_cast<int>((i * 2654435761ull) & 0x7fffffffull); });
+    benchmark_map_type<int, int, std::greater<int>>("int -> int, std::greater", num_keys,
+                                 [](size_t i) { return static_cast<int>((i * 2654435761ull) & 0x7fffffffull); });
+    benchmark_map_type<int64_t, int64_t>("int64 -> int64", num_keys,
+                                         [&](size_t i) { return static_cast<int64_t>(hashed(i)); });
+    benchmark_map_type<FixedString<16>, int>("char[16] -> int", num_keys, [&](size_t i) {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hashed(i)));
+        return FixedString<16>(text);
+    });
+    benchmark_map_type<int64_t, Payload64>("int64 -> 64-byte struct", num_keys,
+                                           [&](size_t i) { return static_cast<int64_t>(hashed(i)); });
+}
+
+// Tail latency from the instrumented maps: find() from `threads` reader threads
+// (merged per-thread histograms) and single-threaded insert(), every operation
+// timed. The first line is the price of the instrumentation: the same probes
+// through a plain CacheFriendlyMap::get and an instrumented one, timing every
+// call and one call in 64.
+inline void print_latency_summary(const char* label, const LatencySummary& summary) {
+    std::cout << "    " << label << ": " << summary.count << " ops from " << summary.threads << " threads, p50 "
+              << summary.p50_ns << " ns, p99 " << summary.p99_ns << " ns, p99.9 " << summary.p999_ns
+              << " ns, max " << summary.max_ns << " ns\n";
+}
+
+template <typename Map>
+void run_latency_readers(const Map& map, const std::vector<int>& probes, size_t threads) {
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < threads; ++t) {
+        readers.emplace_back([&map, &probes, t, threads] {
+            long sum = 0;
+            for (size_t i = t; i < probes.size(); i += threads) sum += map.find(probes[i]).value_or(0);
+            volatile long checksum = sum;
+            (void)checksum;
+        });
+    }
+    for (auto& reader : readers) reader.join();
+}
+
+template <typename Map>
+void report_map_latency(const char* label, Map& map, const std::vector<int>& probes,
+                        const std::vector<int>& new_keys, size_t threads) {
+    map.lookup_latency().reset();
+    map.insert_latency().reset();
+    run_latency_readers(map, probes, threads);
+    for (int key : new_keys) map.insert(key, key);
+    std::cout << "  " << label << ":\n";
+    print_latency_summary("find", map.lookup_latency().summary());
+    print_latency_summary("insert", map.insert_latency().summary());
+}
+
+void benchmark_map_latency(size_t num_keys = 1000000, size_t num_ops = 1000000, size_t threads = 4) {
+    WorkloadSpec spec;
+    spec.record_count = num_keys;
+    std::vector<int> keys = WorkloadGenerator(spec).load_keys();
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20, 71);
+    std::vector<int> probes = generate_random_ints(num_ops, 0, static_cast<int>(num_keys - 1), 72);
+    for (int& p : probes) p = keys[p];
+    // Each CacheFriendlyMap insert moves half the array: keep the count small.
+    std::vector<int> new_keys = generate_random_ints(std::max<size_t>(1, num_ops / 100), 0, INT_MAX, 73);
+
+    CacheFriendlyMap<> plain(num_keys);
+    plain.bulk_insert(keys, values);
+    CacheFriendlyMap<int, int, std::less<int>, true> timed(num_keys);
+    timed.bulk_insert(keys, values);
+    auto per_get_ns = [&probes](const auto& map) {
+        volatile long checksum = 0;
+        long sum = 0;
+        Stopwatch sw;
+        sw.start();
+        for (int key : probes) sum += map.get(key);
+        Timing t = sw.stop();
+        checksum += sum;
+        return t.ns / probes.size();
+    };
+    per_get_ns(plain);
+    std::cout << "Map operation latency, " << num_keys << " keys:\n";
+    std::cout << "  instrumentation cost: CacheFriendlyMap::get " << per_get_ns(plain) << " ns plain";
+    for (uint64_t period : {1, 64}) {
+        timed.lookup_latency().set_sample_period(period);
+        per_get_ns(timed);
+        std::cout << ", " << per_get_ns(timed) << " ns timing 1 in " << period;
+    }
+    std::cout << "\n";
+    timed.lookup_latency().set_sample_period(1);
+    report_map_latency("CacheFriendlyMap", timed, probes, new_keys, threads);
+
+    OptimizedMap<int, int, std::less<int>, true> tree;
+    for (size_t i = 0; i < num_keys; ++i) tree.insert(keys[i], values[i]);
+    report_map_latency("OptimizedMap (std::map)", tree, probes, new_keys, threads);
+
+    // O(n) per operation: a smaller map and fewer operations.
+    constexpr size_t kNaiveKeys = 10000;
+    NaiveMap<int, int, std::less<int>, true> naive;
+    for (size_t i = 0; i < kNaiveKeys; ++i) naive.insert(keys[i], values[i]);
+    std::vector<int> naive_probes(probes.begin(), probes.begin() + std::min<size_t>(probes.size(), kNaiveKeys));
+    for (int& p : naive_probes) p = keys[static_cast<size_t>(p) % kNaiveKeys];
+    std::vector<int> naive_new_keys(new_keys.begin(), new_keys.begin() + std::min<size_t>(new_keys.size(), 1000));
+    report_map_latency("NaiveMap (10k keys)", naive, naive_probes, naive_new_keys, threads);
+}
+
 #endif //PRACTICE_H
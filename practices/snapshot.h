@@ -0,0 +1,274 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "map.h"
+
+// On-disk snapshot of a CacheFriendlyMap, opened with mmap (zero copy).
+// 重启时不再 bulk_insert (排序 + gather)，直接把排好序的数组映射进来：
+// 第一次访问的 page fault 由内核从 page cache / 磁盘填充，不需要解析和拷贝。
+//
+// Layout, every section starts on a page boundary:
+//   [SnapshotHeader][pad] [keys: int32 x count][pad] [values: int32 x count][pad] [index][pad]
+// The optional index holds every kSnapshotIndexStride-th key. It is small
+// enough to stay cached, so a cold lookup touches one index page plus one page
+// of keys instead of ~log2(count / 1024) pages along a full binary search.
+
+constexpr char kSnapshotMagic[8] = {'C', 'F', 'M', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t kSnapshotVersion = 1;
+constexpr uint64_t kSnapshotAlign = 4096;
+constexpr uint32_t kSnapshotIndexStride = 256;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t index_stride;  // keys per index entry, never 0
+    uint64_t count;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint64_t file_size;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader is one cache line");
+
+enum class SnapshotWarmup {
+    None,        // fault pages in on first touch
+    Populate,    // MAP_POPULATE: prefault the whole mapping in mmap()
+    WillNeed,    // madvise(MADV_WILLNEED): async readahead
+    Random,      // madvise(MADV_RANDOM): no readahead, good for point lookups on cold data
+};
+
+inline uint64_t snapshot_align(uint64_t offset) {
+    return (offset + kSnapshotAlign - 1) / kSnapshotAlign * kSnapshotAlign;
+}
+
+inline void write_all(int fd, const void* data, size_t bytes, uint64_t offset, const std::string& path) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = pwrite(fd, p, bytes, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to write snapshot " + path + ": " + std::strerror(errno));
+        }
+        p += n;
+        offset += n;
+        bytes -= n;
+    }
+}
+
+void write_snapshot(const CacheFriendlyMap<>& map, const std::string& path, bool with_index = true) {
+    const std::vector<int>& keys = map.keys();
+    const std::vector<int>& values = map.values();
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    header.version = kSnapshotVersion;
+    header.count = keys.size();
+    header.keys_offset = snapshot_align(sizeof(SnapshotHeader));
+    header.values_offset = snapshot_align(header.keys_offset + keys.size() * sizeof(int));
+    header.index_offset = snapshot_align(header.values_offset + values.size() * sizeof(int));
+
+    std::vector<int> index;
+    header.index_stride = kSnapshotIndexStride;  // index_count 0: no index
+    if (with_index) {
+        for (size_t i = 0; i < keys.size(); i += kSnapshotIndexStride) {
+            index.push_back(keys[i]);
+        }
+    }
+    header.index_count = index.size();
+    header.file_size = snapshot_align(header.index_offset + index.size() * sizeof(int));
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create snapshot " + path + ": " + std::strerror(errno));
+    }
+    try {
+        if (ftruncate(fd, static_cast<off_t>(header.file_size)) != 0) {
+            throw std::runtime_error("Failed to size snapshot " + path + ": " + std::strerror(errno));
+        }
+        write_all(fd, &header, sizeof(header), 0, path);
+        write_all(fd, keys.data(), keys.size() * sizeof(int), header.keys_offset, path);
+        write_all(fd, values.data(), values.size() * sizeof(int), header.values_offset, path);
+        write_all(fd, index.data(), index.size() * sizeof(int), header.index_offset, path);
+        if (fsync(fd) != 0) {
+            throw std::runtime_error("Failed to sync snapshot " + path + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+// [offset, offset + count * element) lies inside a file of `length` bytes,
+// without overflowing on a corrupt header.
+inline bool snapshot_section_fits(uint64_t offset, uint64_t count, uint64_t element, uint64_t length) {
+    return offset % element == 0 && offset <= length && count <= (length - offset) / element;
+}
+
+// Read-only CacheFriendlyMap served straight from the mapping.
+class MappedCacheFriendlyMap {
+public:
+    MappedCacheFriendlyMap(const std::string& path, SnapshotWarmup warmup = SnapshotWarmup::None) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open snapshot " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Snapshot " + path + " is truncated");
+        }
+        length_ = static_cast<size_t>(st.st_size);
+        int flags = MAP_PRIVATE | (warmup == SnapshotWarmup::Populate ? MAP_POPULATE : 0);
+        void* base = mmap(nullptr, length_, PROT_READ, flags, fd, 0);
+        ::close(fd);  // the mapping keeps the file referenced
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("Failed to mmap snapshot " + path + ": " + std::strerror(errno));
+        }
+        base_ = static_cast<const char*>(base);
+
+        const auto* header = reinterpret_cast<const SnapshotHeader*>(base_);
+        // find() trusts these: every section inside the file, and an index of
+        // exactly one entry per stride keys.
+        if (std::memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0
+            || header->version != kSnapshotVersion || header->file_size > length_ || header->index_stride == 0
+            || !snapshot_section_fits(header->keys_offset, header->count, sizeof(int), length_)
+            || !snapshot_section_fits(header->values_offset, header->count, sizeof(int), length_)
+            || !snapshot_section_fits(header->index_offset, header->index_count, sizeof(int), length_)
+            || (header->index_count != 0
+                && header->index_count != (header->count + header->index_stride - 1) / header->index_stride)) {
+            munmap(const_cast<char*>(base_), length_);
+            throw std::runtime_error("Snapshot " + path + " has a bad header or version");
+        }
+        count_ = header->count;
+        keys_ = reinterpret_cast<const int*>(base_ + header->keys_offset);
+        values_ = reinterpret_cast<const int*>(base_ + header->values_offset);
+        index_ = reinterpret_cast<const int*>(base_ + header->index_offset);
+        index_count_ = header->index_count;
+        index_stride_ = header->index_stride;
+
+        if (warmup == SnapshotWarmup::WillNeed) {
+            madvise(const_cast<char*>(base_), length_, MADV_WILLNEED);
+        } else if (warmup == SnapshotWarmup::Random) {
+            madvise(const_cast<char*>(base_), length_, MADV_RANDOM);
+        }
+    }
+
+    ~MappedCacheFriendlyMap() {
+        if (base_ != nullptr) {
+            munmap(const_cast<char*>(base_), length_);
+        }
+    }
+
+    MappedCacheFriendlyMap(const MappedCacheFriendlyMap&) = delete;
+    MappedCacheFriendlyMap& operator=(const MappedCacheFriendlyMap&) = delete;
+
+    int get(int key) const {
+        if (auto value = find(key)) {
+            return *value;
+        }
+        throw std::runtime_error("Key not found");
+    }
+
+    std::optional<int> find(int key) const {
+        const int* first = keys_;
+        const int* last = keys_ + count_;
+        if (index_count_ > 0) {
+            // index[b - 1] < key <= index[b], so the first match lies in
+            // keys[(b - 1) * stride + 1, b * stride].
+            size_t block = std::lower_bound(index_, index_ + index_count_, key) - index_;
+            first = keys_ + (block == 0 ? 0 : (block - 1) * index_stride_);
+            last = keys_ + std::min(count_, block * index_stride_ + 1);
+        }
+        const int* it = std::lower_bound(first, last, key);
+        if (__builtin_expect(it != last && *it == key, 1)) {
+            return values_[it - keys_];
+        }
+        return std::nullopt;
+    }
+
+    size_t size() const { return count_; }
+
+private:
+    const char* base_ = nullptr;
+    size_t length_ = 0;
+    size_t count_ = 0;
+    const int* keys_ = nullptr;
+    const int* values_ = nullptr;
+    const int* index_ = nullptr;
+    size_t index_count_ = 0;
+    size_t index_stride_ = 0;
+};
+
+// Drop the file from the page cache so the next open is a real cold start.
+inline void evict_from_page_cache(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+// Restart cost: rebuild with bulk_insert vs open the snapshot, then lookup
+// latency for the first (cold) lookups and after the pages are resident.
+void benchmark_snapshot(size_t num_keys = 10000000, const std::string& path = "/tmp/cache_friendly_map.snap") {
+    WorkloadSpec spec;
+    spec.record_count = num_keys;
+    std::vector<int> keys = WorkloadGenerator(spec).load_keys();
+    std::vector<int> values = generate_random_ints(num_keys, 1, 1 << 20, 31);
+    std::vector<int> probes = generate_random_ints(10000, 0, static_cast<int>(num_keys - 1), 32);
+    for (int& p : probes) p = keys[p];
+
+    auto lookups_ns = [&probes](const auto& map, size_t count) {
+        volatile long checksum = 0;
+        Stopwatch sw;
+        sw.start();
+        for (size_t i = 0; i < count; ++i) checksum += map.get(probes[i]);
+        return sw.stop().ns / count;
+    };
+
+    CacheFriendlyMap<> map(num_keys);
+    Stopwatch sw;
+    sw.start();
+    map.bulk_insert(keys, values);
+    double rebuild_ms = sw.stop().ns * 1e-6;
+    std::cout << "Snapshot of " << num_keys << " keys:\n";
+    std::cout << "  rebuild (bulk_insert): " << rebuild_ms << " ms, warm lookup " << lookups_ns(map, probes.size()) << " ns\n";
+    sw.start();
+    write_snapshot(map, path);
+    std::cout << "  write snapshot: " << sw.stop().ns * 1e-6 << " ms\n";
+
+    const std::pair<const char*, SnapshotWarmup> modes[] = {
+        {"none", SnapshotWarmup::None}, {"MAP_POPULATE", SnapshotWarmup::Populate},
+        {"MADV_WILLNEED", SnapshotWarmup::WillNeed}, {"MADV_RANDOM", SnapshotWarmup::Random}};
+    for (const auto& mode : modes) {
+        evict_from_page_cache(path);
+        sw.start();
+        MappedCacheFriendlyMap mapped(path, mode.second);
+        double open_ms = sw.stop().ns * 1e-6;
+        double cold_ns = lookups_ns(mapped, 1000);
+        lookups_ns(mapped, probes.size());  // fault in the remaining probe pages
+        double warm_ns = lookups_ns(mapped, probes.size());
+        std::cout << "  mmap (" << mode.first << "): open " << open_ms << " ms, first 1000 lookups "
+                  << cold_ns << " ns, warm " << warm_ns << " ns\n";
+    }
+    std::remove(path.c_str());
+}
+
+#endif //SNAPSHOT_H
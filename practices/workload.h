@@ -0,0 +1,209 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 负载生成器：可复现 (固定 seed)，支持多种 key 分布和 YCSB 风格的读写混合。
+// 连续 key (generate_continous_ints) 对所有 map 的分支预测都太友好;
+// 真实的缓存/索引负载通常是倾斜的 (Zipfian): 少数热 key 占大部分访问。
+//
+// Keys are produced from record ordinals 0..n-1. With `hash_keys` the ordinal
+// goes through an odd-multiplier permutation of [0, 2^31), so keys are unique,
+// unsorted and still reproducible; without it key == ordinal.
+
+enum class KeyDistribution { Uniform, Zipfian, Hotspot, Sequential, Latest };
+
+enum class OpType { Read, Update, Insert, Scan };
+
+struct Operation {
+    OpType type;
+    int key;
+    int value;
+    int scan_length;  // only for OpType::Scan
+    int scan_hi;      // inclusive upper key covering ~scan_length records
+};
+
+struct WorkloadSpec {
+    std::string name = "custom";
+    double read_proportion = 1.0;
+    double update_proportion = 0.0;
+    double insert_proportion = 0.0;
+    double scan_proportion = 0.0;
+    KeyDistribution distribution = KeyDistribution::Uniform;
+    double zipf_theta = 0.99;          // YCSB default skew
+    double hotspot_data_fraction = 0.2;
+    double hotspot_op_fraction = 0.8;  // 80% of ops go to 20% of the keys
+    size_t record_count = 10000;
+    size_t operation_count = 100000;
+    int max_scan_length = 100;
+    bool hash_keys = true;
+    uint64_t seed = 42;
+};
+
+// YCSB core workloads (F, read-modify-write, is A with RMW and left out).
+inline WorkloadSpec ycsb_workload(char which) {
+    WorkloadSpec spec;
+    spec.distribution = KeyDistribution::Zipfian;
+    switch (which) {
+        case 'A': spec.name = "YCSB-A (50/50 read/update)"; spec.read_proportion = 0.5; spec.update_proportion = 0.5; break;
+        case 'B': spec.name = "YCSB-B (95/5 read/update)"; spec.read_proportion = 0.95; spec.update_proportion = 0.05; break;
+        case 'C': spec.name = "YCSB-C (read only)"; spec.read_proportion = 1.0; break;
+        case 'D': spec.name = "YCSB-D (95/5 read/insert, latest)"; spec.read_proportion = 0.95; spec.insert_proportion = 0.05;
+                  spec.distribution = KeyDistribution::Latest; break;
+        case 'E': spec.name = "YCSB-E (95/5 scan/insert)"; spec.read_proportion = 0.0; spec.scan_proportion = 0.95;
+                  spec.insert_proportion = 0.05; break;
+        default: throw std::invalid_argument("Unknown YCSB workload");
+    }
+    return spec;
+}
+
+// Gray et al. "Quickly generating billion-record synthetic databases", as in
+// YCSB's ZipfianGenerator. zeta(n) is extended incrementally when n grows
+// (the Latest distribution grows with every insert).
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t items, double theta) : theta_(theta) {
+        if (theta <= 0.0 || theta >= 1.0) {
+            throw std::invalid_argument("Zipfian theta must be in (0, 1)");
+        }
+        alpha_ = 1.0 / (1.0 - theta_);
+        zeta2_ = 1.0 + std::pow(0.5, theta_);
+        resize(items);
+    }
+
+    template <typename Rng>
+    uint64_t next(Rng& rng, uint64_t items) {
+        if (items != items_) {
+            resize(items);
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < zeta2_) return 1;
+        uint64_t r = static_cast<uint64_t>(items_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return r < items_ ? r : items_ - 1;
+    }
+
+private:
+    void resize(uint64_t items) {
+        for (uint64_t i = zeta_items_ + 1; i <= items; ++i) {
+            zetan_ += 1.0 / std::pow(static_cast<double>(i), theta_);
+        }
+        zeta_items_ = std::max(zeta_items_, items);
+        items_ = items;
+        eta_ = (1.0 - std::pow(2.0 / items_, 1.0 - theta_)) / (1.0 - zeta2_ / zetan_);
+    }
+
+    double theta_, alpha_, zeta2_, eta_ = 0.0, zetan_ = 0.0;
+    uint64_t items_ = 0, zeta_items_ = 0;
+};
+
+class WorkloadGenerator {
+public:
+    explicit WorkloadGenerator(const WorkloadSpec& spec)
+        : spec_(spec), rng_(spec.seed), zipf_(std::max<size_t>(spec.record_count, 2), spec.zipf_theta) {
+        double total = spec.read_proportion + spec.update_proportion + spec.insert_proportion + spec.scan_proportion;
+        if (spec.record_count == 0 || total <= 0.0) {
+            throw std::invalid_argument("Workload needs records and a non-empty operation mix");
+        }
+    }
+
+    // Keys inserted before the timed phase, ordinals 0..record_count-1.
+    std::vector<int> load_keys() const {
+        std::vector<int> keys(spec_.record_count);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = key_for(i);
+        }
+        return keys;
+    }
+
+    // The timed phase. Inserts append new ordinals after record_count.
+    std::vector<Operation> operations() {
+        std::vector<Operation> ops;
+        ops.reserve(spec_.operation_count);
+        uint64_t inserted = spec_.record_count;
+        uint64_t cursor = 0;
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        std::uniform_int_distribution<int> value_dist(1, 1 << 30);
+        std::uniform_int_distribution<int> scan_dist(1, spec_.max_scan_length);
+        double total = spec_.read_proportion + spec_.update_proportion + spec_.insert_proportion + spec_.scan_proportion;
+
+        for (size_t i = 0; i < spec_.operation_count; ++i) {
+            double pick = coin(rng_) * total;
+            Operation op{OpType::Read, 0, value_dist(rng_), 0, 0};
+            if ((pick -= spec_.read_proportion) < 0) {
+                op.type = OpType::Read;
+            } else if ((pick -= spec_.update_proportion) < 0) {
+                op.type = OpType::Update;
+            } else if ((pick -= spec_.insert_proportion) < 0) {
+                op.type = OpType::Insert;
+            } else {
+                op.type = OpType::Scan;
+                op.scan_length = scan_dist(rng_);
+            }
+            if (op.type == OpType::Insert) {
+                op.key = key_for(inserted++);
+            } else {
+                op.key = key_for(next_ordinal(inserted, cursor));
+            }
+            if (op.type == OpType::Scan) {
+                op.scan_hi = scan_upper_key(op.key, op.scan_length, inserted);
+            }
+            ops.push_back(op);
+        }
+        return ops;
+    }
+
+    const WorkloadSpec& spec() const { return spec_; }
+
+private:
+    int key_for(uint64_t ordinal) const {
+        if (!spec_.hash_keys) {
+            return static_cast<int>(ordinal);
+        }
+        // Odd multiplier --> bijection on [0, 2^31).
+        return static_cast<int>((ordinal * 2654435761ull) & 0x7fffffffull);
+    }
+
+    // Hashed keys are spread evenly over [0, 2^31), so a key span of
+    // length * 2^31 / records covers about `length` records.
+    int scan_upper_key(int key, int length, uint64_t records) const {
+        uint64_t span = spec_.hash_keys ? length * ((1ull << 31) / records) : static_cast<uint64_t>(length - 1);
+        return static_cast<int>(std::min<uint64_t>(0x7fffffffull, static_cast<uint64_t>(key) + span));
+    }
+
+    uint64_t next_ordinal(uint64_t items, uint64_t& cursor) {
+        switch (spec_.distribution) {
+            case KeyDistribution::Uniform:
+                return std::uniform_int_distribution<uint64_t>(0, items - 1)(rng_);
+            case KeyDistribution::Zipfian:
+                // Unscrambled: ordinal 0 is the hottest. With hash_keys the hot
+                // ordinals are still spread over the key space.
+                return zipf_.next(rng_, items);
+            case KeyDistribution::Latest:
+                return items - 1 - zipf_.next(rng_, items);
+            case KeyDistribution::Hotspot: {
+                uint64_t hot = std::max<uint64_t>(1, static_cast<uint64_t>(items * spec_.hotspot_data_fraction));
+                if (std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < spec_.hotspot_op_fraction || hot == items) {
+                    return std::uniform_int_distribution<uint64_t>(0, hot - 1)(rng_);
+                }
+                return std::uniform_int_distribution<uint64_t>(hot, items - 1)(rng_);
+            }
+            case KeyDistribution::Sequential:
+            default:
+                return cursor++ % items;
+        }
+    }
+
+    WorkloadSpec spec_;
+    std::mt19937_64 rng_;
+    ZipfianGenerator zipf_;
+};
+
+#endif //WORKLOAD_H
@@ -0,0 +1,29 @@
+#include "../practices/compressed_map.h"
+#include "check.h"
+
+// Every key found with its value, the gaps between keys not found.
+static void check_round_trip(size_t n) {
+    CacheFriendlyMap<> source(n);
+    std::vector<int> keys(n), values(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<int>(i * 3);
+        values[i] = static_cast<int>(i + 1);
+    }
+    source.bulk_insert(keys, values);
+    CompressedCacheFriendlyMap compressed(source);
+    CHECK(compressed.size() == n);
+    for (size_t i = 0; i < n; ++i) {
+        CHECK(compressed.get(keys[i]) == values[i]);
+        CHECK(!compressed.find(keys[i] + 1));
+    }
+    CHECK(!compressed.find(-1));
+}
+
+int main() {
+    // A last block with a single key has range 0 and packs no words.
+    check_round_trip(1);
+    check_round_trip(CompressedCacheFriendlyMap::kBlockKeys + 1);
+    check_round_trip(2 * CompressedCacheFriendlyMap::kBlockKeys);
+    check_round_trip(1000);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "../practices/snapshot.h"
+#include "check.h"
+
+#include <cstdio>
+
+static bool opens(const std::string& path) {
+    try {
+        MappedCacheFriendlyMap mapped(path);
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+static SnapshotHeader read_header(const std::string& path) {
+    SnapshotHeader header{};
+    FILE* f = std::fopen(path.c_str(), "rb");
+    CHECK(f != nullptr && std::fread(&header, sizeof(header), 1, f) == 1);
+    std::fclose(f);
+    return header;
+}
+
+static void write_header(const std::string& path, const SnapshotHeader& header) {
+    FILE* f = std::fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr && std::fwrite(&header, sizeof(header), 1, f) == 1);
+    std::fclose(f);
+}
+
+int main() {
+    const std::string path = "/tmp/snapshot_test." + std::to_string(getpid()) + ".snap";
+    constexpr size_t n = 10000;
+    CacheFriendlyMap<> map(n);
+    std::vector<int> keys(n), values(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<int>(i * 2);
+        values[i] = static_cast<int>(i + 1);
+    }
+    map.bulk_insert(keys, values);
+
+    for (bool with_index : {true, false}) {
+        write_snapshot(map, path, with_index);
+        MappedCacheFriendlyMap mapped(path);
+        CHECK(mapped.size() == n);
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(mapped.get(keys[i]) == values[i]);
+            CHECK(!mapped.find(keys[i] + 1));
+        }
+    }
+
+    // Truncated in the middle of the values, with file_size patched to match,
+    // so only the section bounds can catch it.
+    write_snapshot(map, path);
+    SnapshotHeader header = read_header(path);
+    uint64_t cut = header.values_offset + n * sizeof(int) / 2;
+    CHECK(truncate(path.c_str(), static_cast<off_t>(cut)) == 0);
+    header.file_size = cut;
+    write_header(path, header);
+    CHECK(!opens(path));
+
+    // count * sizeof(int) overflows to a small number.
+    write_snapshot(map, path);
+    header = read_header(path);
+    header.count = (UINT64_MAX / sizeof(int)) + 2;
+    write_header(path, header);
+    CHECK(!opens(path));
+
+    // index_stride 0 would divide by zero.
+    write_snapshot(map, path);
+    header = read_header(path);
+    header.index_stride = 0;
+    write_header(path, header);
+    CHECK(!opens(path));
+
+    std::remove(path.c_str());
+    return 0;
+}